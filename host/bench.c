@@ -0,0 +1,262 @@
+// ----------------------------------------------------------------------------
+// acperience host benchmarks
+//
+// runs control.c against the stub interface and reports time per operation
+// along with how many calls each operation makes into multipass.
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "interface.h"
+#include "stub.h"
+
+#define DEFAULT_ITERATIONS 200000
+
+// virtual time between clock edges, a 32nd note at 187.5 bpm
+#define CLOCK_PERIOD_MS 10
+// long enough for the render timer to fire at least once
+#define FRAME_MS 50
+
+typedef struct {
+    const char *name;
+    void (*setup)(void);
+    void (*op)(void);
+    u8 report_latency;
+} bench_t;
+
+static u32 iteration;
+
+
+// ----------------------------------------------------------------------------
+// setup
+
+// lets virtual time pass and renders the grid and arc if a refresh was
+// requested
+static void tick(u32 ms) {
+    stub_advance_time(ms);
+    stub_service_grid();
+    stub_service_arc();
+}
+
+static void press(u8 x, u8 y) {
+    stub_grid_key(x, y, 1);
+    stub_grid_key(x, y, 0);
+}
+
+static void setup_pattern(void) {
+    stub_init();
+    init_control();
+
+    // fill all 4 pages with a mix of notes, ties, accents, slides and
+    // octave shifts so every render branch gets exercised
+    for (u8 page = 0; page < 4; page++) {
+        press(6, 2 + page);
+        for (u8 y = 0; y < 8; y++) {
+            stub_grid_key(9, y, 1);
+            stub_grid_key(13 + (y % 3), (y * 3 + page) & 7, 1);
+            stub_grid_key(13 + (y % 3), (y * 3 + page) & 7, 0);
+            stub_grid_key(9, y, 0);
+            if (y % 4 == 3) press(13, y);
+            if (y % 3 == 0) press(14, y);
+            if (y % 5 == 1) press(15, y);
+            if (y == 6) press(8, y);
+            if (y == 2) press(10, y);
+        }
+    }
+    press(6, 2);
+    press(11, 7 - 2);
+
+    tick(FRAME_MS);
+}
+
+static void setup_v(void) {
+    setup_pattern();
+}
+
+static void setup_v_keyboard(void) {
+    setup_pattern();
+    press(5, 7);
+}
+
+static void setup_h(void) {
+    setup_pattern();
+    press(5, 0);
+}
+
+static void setup_h_keyboard(void) {
+    setup_pattern();
+    press(5, 0);
+    press(5, 7);
+}
+
+static void setup_follow(void) {
+    setup_pattern();
+    press(6, 0);
+}
+
+// fresh presets for the default divider of 6 ticks per step
+static void setup_midi(void) {
+    static const u8 start = MIDI_START;
+    init_presets();
+    setup_pattern();
+    stub_midi(&start, 1);
+}
+
+static void setup_voices(void) {
+    setup_pattern();
+    press(0, 7);
+    press(8 + MAX_VOICES - 1, 3);
+    press(0, 6);
+    tick(FRAME_MS);
+}
+
+
+// ----------------------------------------------------------------------------
+// operations
+
+static void op_clock(void) {
+    stub_clock(1);
+    stub_clock(0);
+}
+
+static void op_clock_render(void) {
+    stub_clock(1);
+    tick(CLOCK_PERIOD_MS / 2);
+    stub_clock(0);
+    tick(CLOCK_PERIOD_MS / 2);
+}
+
+// one step of midi clock, a tick at a time like a usb transfer would
+static void op_midi_clock(void) {
+    static const u8 tick = MIDI_CLOCK;
+    for (u8 i = 0; i < 6; i++) {
+        stub_midi(&tick, 1);
+        stub_service_midi();
+    }
+}
+
+// a fast spin on the pitch ring, a burst of events in one frame
+static void op_arc_spin(void) {
+    for (u8 i = 0; i < 16; i++) stub_arc_encoder(1, iteration & 1);
+    tick(FRAME_MS);
+}
+
+static void op_render(void) {
+    // a reconnect invalidates the whole grid, forcing a full redraw
+    stub_grid_connected();
+    tick(FRAME_MS);
+}
+
+static void op_press_gate(void) {
+    stub_grid_key(12, iteration & 7, 1);
+    tick(FRAME_MS);
+    stub_grid_key(12, iteration & 7, 0);
+}
+
+static void op_press_note(void) {
+    stub_grid_key(9, iteration & 7, 1);
+    tick(FRAME_MS);
+    stub_grid_key(13 + (iteration % 3), (iteration >> 3) & 7, 1);
+    tick(FRAME_MS);
+    stub_grid_key(13 + (iteration % 3), (iteration >> 3) & 7, 0);
+    stub_grid_key(9, iteration & 7, 0);
+    tick(FRAME_MS);
+}
+
+static void op_press_menu(void) {
+    stub_grid_key(6, 2 + (iteration & 3), 1);
+    tick(FRAME_MS);
+    stub_grid_key(6, 2 + (iteration & 3), 0);
+}
+
+// a new pattern and the clock that plays it
+static void op_generate(void) {
+    press(2, 7);
+    op_clock();
+}
+
+static void op_load_preset(void) {
+    stub_grid_key(1, iteration & 7, 1);
+    stub_grid_key(1, iteration & 7, 0);
+    stub_clock(1);
+    tick(CLOCK_PERIOD_MS / 2);
+    stub_clock(0);
+    tick(CLOCK_PERIOD_MS / 2);
+}
+
+static const bench_t benchmarks[] = {
+    { "clock",                  setup_v,          op_clock, 1 },
+    { "clock+render V",         setup_v,          op_clock_render, 1 },
+    { "clock 4 voices",         setup_voices,     op_clock, 1 },
+    { "midi clock",             setup_midi,       op_midi_clock, 1 },
+    { "clock+render V kbd",     setup_v_keyboard, op_clock_render },
+    { "clock+render H",         setup_h,          op_clock_render },
+    { "clock+render follow",    setup_follow,     op_clock_render },
+    { "render V",               setup_v,          op_render },
+    { "render V kbd",           setup_v_keyboard, op_render },
+    { "render H",               setup_h,          op_render },
+    { "render H kbd",           setup_h_keyboard, op_render },
+    { "press gate",             setup_v,          op_press_gate },
+    { "press note",             setup_v,          op_press_note },
+    { "press page",             setup_v,          op_press_menu },
+    { "arc spin",               setup_v,          op_arc_spin },
+    { "generate+clock",         setup_v,          op_generate, 1 },
+    { "load preset+clock",      setup_v,          op_load_preset },
+};
+
+
+// ----------------------------------------------------------------------------
+// runner
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void print_latency(const char *name, latency_t *l) {
+    printf("  %-10s worst %6u ns |", name, (unsigned)(l->worst * 1000 / CYCLES_PER_US));
+    for (u8 i = 0; i < LATENCY_BUCKETS; i++)
+        printf(" %s%uus %5.1f%%", i == LATENCY_BUCKETS - 1 ? ">=" : "<",
+            (unsigned)latency_bucket_limit_us(i == LATENCY_BUCKETS - 1 ? i - 1 : i),
+            l->count ? 100.0 * l->histogram[i] / l->count : 0.0);
+    printf("\n");
+}
+
+static void run(const bench_t *b, u32 iterations) {
+    struct timespec start, end;
+    double n = iterations;
+
+    b->setup();
+    stub_reset_calls();
+    latency_reset(get_clock_latency());
+    latency_reset(get_clock_off_latency());
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (iteration = 0; iteration < iterations; iteration++) b->op();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("%-24s %9.1f %7.2f %7.2f %7.2f %8.2f %7.2f %7.2f %7.2f\n",
+        b->name, elapsed_ns(&start, &end) / n,
+        stub_calls.set_cv / n, stub_calls.set_gate / n, stub_calls.note_to_pitch / n,
+        stub_calls.set_grid_led / n, stub_calls.clear_all_grid_leds / n,
+        stub_calls.refresh_grid / n, stub_calls.render_grid / n);
+
+    if (b->report_latency) {
+        print_latency("clock on", get_clock_latency());
+        print_latency("clock off", get_clock_off_latency());
+    }
+}
+
+int main(int argc, char *argv[]) {
+    u32 iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+    if (!iterations) iterations = DEFAULT_ITERATIONS;
+
+    printf("%-24s %9s %7s %7s %7s %8s %7s %7s %7s\n",
+        "benchmark", "ns/op", "cv", "gate", "n2p", "led", "clear", "refresh", "render");
+
+    for (u32 i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+        run(&benchmarks[i], iterations);
+
+    return 0;
+}
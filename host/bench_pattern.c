@@ -0,0 +1,187 @@
+// ----------------------------------------------------------------------------
+// pattern layout benchmarks
+//
+// compares the bit plane pattern_t in engine.c against the original layout
+// of one step_t per step.
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "engine.h"
+
+#define DEFAULT_ITERATIONS 1000000
+#define NOINLINE __attribute__((noinline))
+
+
+// ----------------------------------------------------------------------------
+// original layout
+
+typedef struct {
+    s8 pitch;
+    u8 gate;
+    u8 accent;
+    u8 slide;
+    u8 transpose;
+    u8 is_reset;
+} legacy_step_t;
+
+typedef struct {
+    legacy_step_t steps[MAX_PATTERN_LENGTH];
+} legacy_pattern_t;
+
+typedef struct {
+    legacy_pattern_t p;
+    pattern_state_t ps;
+} legacy_engine_pattern_t;
+
+static NOINLINE void legacy_step(legacy_engine_pattern_t *ep) {
+    if (ep->p.steps[ep->ps.current_step].is_reset || ++ep->ps.current_step >= MAX_PATTERN_LENGTH)
+        ep->ps.current_step = 0;
+}
+
+static NOINLINE u8 legacy_get_gate(legacy_engine_pattern_t *ep, u8 step) {
+    return ep->p.steps[step].gate;
+}
+
+static NOINLINE u8 legacy_get_accent(legacy_engine_pattern_t *ep, u8 step) {
+    return ep->p.steps[step].accent;
+}
+
+static NOINLINE s8 legacy_get_pitch_transposed(legacy_engine_pattern_t *ep, u8 step) {
+    s8 pitch = ep->p.steps[step].pitch;
+    if (ep->p.steps[step].transpose == TRANSPOSE_UP) pitch += 12;
+    else if (ep->p.steps[step].transpose == TRANSPOSE_DOWN) pitch -= 12;
+    return pitch;
+}
+
+static NOINLINE void legacy_set_gate(legacy_engine_pattern_t *ep, u8 step, u8 gate) {
+    if (step >= MAX_PATTERN_LENGTH) return;
+    ep->p.steps[step].gate = gate;
+}
+
+
+// ----------------------------------------------------------------------------
+// fixtures
+
+static legacy_engine_pattern_t legacy;
+static engine_pattern_t packed;
+static volatile u32 sink;
+
+static void fill(void) {
+    step_t s;
+    e_init(&packed);
+    for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++) {
+        s.pitch = (i * 7) % (MAX_PITCH_VALUE + 1);
+        s.gate = i % 5 == 4 ? GATE_REST : i % 3 == 2 ? GATE_TIE : GATE_ON;
+        s.accent = i % 4 == 0;
+        s.slide = i % 6 == 5;
+        s.transpose = i % 8 == 3 ? TRANSPOSE_UP : i % 8 == 6 ? TRANSPOSE_DOWN : TRANSPOSE_OFF;
+        s.is_reset = i == MAX_PATTERN_LENGTH - 5;
+        s.ratchet = 1;
+        legacy.p.steps[i].pitch = s.pitch;
+        legacy.p.steps[i].gate = s.gate;
+        legacy.p.steps[i].accent = s.accent;
+        legacy.p.steps[i].slide = s.slide;
+        legacy.p.steps[i].transpose = s.transpose;
+        legacy.p.steps[i].is_reset = s.is_reset;
+        e_set_step(&packed, i, &s);
+    }
+    legacy.ps.current_step = packed.ps.current_step = 0;
+}
+
+static u32 count_bits(step_mask_t mask) {
+    u32 count = 0;
+    for (; mask; count++) mask &= mask - 1;
+    return count;
+}
+
+
+// ----------------------------------------------------------------------------
+// operations
+
+static void legacy_op_step(u32 i) {
+    legacy_step(&legacy);
+    sink = legacy_get_pitch_transposed(&legacy, legacy.ps.current_step) + legacy_get_gate(&legacy, legacy.ps.current_step);
+}
+
+static void packed_op_step(u32 i) {
+    e_step(&packed);
+    sink = e_get_current_pitch_transposed(&packed) + e_get_current_gate(&packed);
+}
+
+static void legacy_op_accent_count(u32 i) {
+    u32 count = 0;
+    for (u8 s = 0; s < MAX_PATTERN_LENGTH; s++) count += legacy_get_accent(&legacy, s) != 0;
+    sink = count;
+}
+
+static void packed_op_accent_count(u32 i) {
+    sink = count_bits(e_get_accent_mask(&packed));
+}
+
+static void legacy_op_scan(u32 i) {
+    u32 sum = 0;
+    for (u8 s = 0; s < MAX_PATTERN_LENGTH; s++)
+        if (legacy_get_gate(&legacy, s) != GATE_REST) sum += legacy_get_pitch_transposed(&legacy, s);
+    sink = sum;
+}
+
+static void packed_op_scan(u32 i) {
+    u32 sum = 0;
+    for (u8 s = 0; s < MAX_PATTERN_LENGTH; s++)
+        if (e_get_gate(&packed, s) != GATE_REST) sum += e_get_pitch_transposed(&packed, s);
+    sink = sum;
+}
+
+static void legacy_op_edit(u32 i) {
+    u8 s = i & (MAX_PATTERN_LENGTH - 1);
+    legacy_set_gate(&legacy, s, legacy_get_gate(&legacy, s) == GATE_ON ? GATE_REST : GATE_ON);
+}
+
+static void packed_op_edit(u32 i) {
+    u8 s = i & (MAX_PATTERN_LENGTH - 1);
+    e_set_gate(&packed, s, e_get_gate(&packed, s) == GATE_ON ? GATE_REST : GATE_ON);
+}
+
+typedef struct {
+    const char *name;
+    void (*legacy)(u32 i);
+    void (*packed)(u32 i);
+} bench_t;
+
+static const bench_t benchmarks[] = {
+    { "step + read",      legacy_op_step,         packed_op_step },
+    { "count accents",    legacy_op_accent_count, packed_op_accent_count },
+    { "scan gated steps", legacy_op_scan,         packed_op_scan },
+    { "toggle gate",      legacy_op_edit,         packed_op_edit },
+};
+
+
+// ----------------------------------------------------------------------------
+// runner
+
+static double time_op(void (*op)(u32 i), u32 iterations) {
+    struct timespec start, end;
+    fill();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (u32 i = 0; i < iterations; i++) op(i);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / iterations;
+}
+
+int main(int argc, char *argv[]) {
+    u32 iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+    if (!iterations) iterations = DEFAULT_ITERATIONS;
+
+    printf("pattern size: legacy %u bytes, packed %u bytes\n",
+        (unsigned)sizeof(legacy_pattern_t), (unsigned)sizeof(pattern_t));
+    printf("%-20s %12s %12s\n", "benchmark", "legacy ns", "packed ns");
+
+    for (u32 i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+        printf("%-20s %12.2f %12.2f\n", benchmarks[i].name,
+            time_op(benchmarks[i].legacy, iterations), time_op(benchmarks[i].packed, iterations));
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+// ----------------------------------------------------------------------------
+// host stand-in for the ASF compiler.h
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <time.h>
+
+// the host cycle counter counts nanoseconds, see CYCLES_PER_US in the Makefile.
+// with STUB_NO_CYCLES it stands still and everything takes no time.
+static inline unsigned long Get_sys_count(void) {
+#ifdef STUB_NO_CYCLES
+    return 0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+#endif
+}
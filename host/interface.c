@@ -0,0 +1,347 @@
+// ----------------------------------------------------------------------------
+// host implementation of the multipass interface
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#include "interface.h"
+#include "config.h"
+#include "stub.h"
+
+typedef struct {
+    u8 active;
+    u8 repeat;
+    u16 interval;
+    u64 due;
+} stub_timer_t;
+
+stub_calls_t stub_calls;
+
+static u64 now;
+static u8 grid_dirty, arc_dirty;
+static u8 grid_leds[16][16];
+static stub_timer_t timers[STUB_TIMER_COUNT];
+static u8 timer_end; // timers from here on have never been added
+
+static preset_meta_t flash_meta[STUB_PRESET_COUNT];
+static preset_data_t flash_presets[STUB_PRESET_COUNT];
+static shared_data_t flash_shared;
+static u8 flash_preset_index;
+
+static stub_output_callback_t output_callback;
+static stub_event_handler_t event_handler = process_event;
+
+
+// ----------------------------------------------------------------------------
+// stub controls
+
+void stub_init(void) {
+    now = 0;
+    grid_dirty = arc_dirty = 0;
+    memset(grid_leds, 0, sizeof(grid_leds));
+    memset(timers, 0, sizeof(timers));
+    timer_end = 0;
+    output_callback = NULL;
+    event_handler = process_event;
+    stub_reset_calls();
+}
+
+void stub_reset_calls(void) {
+    memset(&stub_calls, 0, sizeof(stub_calls));
+}
+
+void stub_set_output_callback(stub_output_callback_t callback) {
+    output_callback = callback;
+}
+
+void stub_set_event_handler(stub_event_handler_t handler) {
+    event_handler = handler ? handler : process_event;
+}
+
+// preset_meta_t can be empty, fwrite and fread count zero sized items as failed
+static u8 write_block(FILE *f, const void *data, size_t size) {
+    return !size || fwrite(data, size, 1, f) == 1;
+}
+
+static u8 read_block(FILE *f, void *data, size_t size) {
+    return !size || fread(data, size, 1, f) == 1;
+}
+
+u8 stub_save_flash(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+
+    u8 ok = write_block(f, flash_meta, sizeof(flash_meta)) &&
+        write_block(f, flash_presets, sizeof(flash_presets)) &&
+        write_block(f, &flash_shared, sizeof(flash_shared)) &&
+        write_block(f, &flash_preset_index, sizeof(flash_preset_index));
+
+    return fclose(f) == 0 && ok;
+}
+
+u8 stub_load_flash(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+
+    u8 ok = read_block(f, flash_meta, sizeof(flash_meta)) &&
+        read_block(f, flash_presets, sizeof(flash_presets)) &&
+        read_block(f, &flash_shared, sizeof(flash_shared)) &&
+        read_block(f, &flash_preset_index, sizeof(flash_preset_index));
+
+    fclose(f);
+    return ok;
+}
+
+void stub_service_grid(void) {
+    if (!grid_dirty) return;
+    grid_dirty = 0;
+    stub_calls.render_grid++;
+    render_grid();
+}
+
+void stub_service_arc(void) {
+    if (!arc_dirty) return;
+    arc_dirty = 0;
+    stub_calls.render_arc++;
+    render_arc();
+}
+
+void stub_advance_time(u32 ms) {
+    u64 end = now + ms, due;
+    u8 data[1];
+
+    while (1) {
+        due = end;
+        for (u8 i = 0; i < timer_end; i++)
+            if (timers[i].active && timers[i].due < due) due = timers[i].due;
+        now = due;
+
+        for (u8 i = 0; i < timer_end; i++) {
+            if (!timers[i].active || timers[i].due > now) continue;
+            if (timers[i].repeat)
+                timers[i].due = now + timers[i].interval;
+            else
+                timers[i].active = 0;
+            data[0] = i;
+            event_handler(TIMED_EVENT, data, 1);
+        }
+
+        if (now >= end) return;
+    }
+}
+
+u8 stub_timer_active(u8 index) {
+    return index < STUB_TIMER_COUNT && timers[index].active;
+}
+
+void stub_clock(u8 on) {
+    u8 data[2] = { 0, on };
+    event_handler(MAIN_CLOCK_RECEIVED, data, 2);
+}
+
+void stub_grid_key(u8 x, u8 y, u8 pressed) {
+    u8 data[3] = { x, y, pressed };
+    event_handler(GRID_KEY_PRESSED, data, 3);
+}
+
+void stub_grid_connected(void) {
+    u8 data[1] = { 1 };
+    event_handler(GRID_CONNECTED, data, 1);
+}
+
+void stub_arc_encoder(u8 encoder, u8 clockwise) {
+    u8 data[2] = { encoder, clockwise };
+    event_handler(ARC_ENCODER_COARSE, data, 2);
+}
+
+void stub_arc_connected(void) {
+    u8 data[1] = { 1 };
+    event_handler(ARC_CONNECTED, data, 1);
+}
+
+void stub_front_button(u8 pressed) {
+    u8 data[1] = { pressed };
+    event_handler(FRONT_BUTTON_PRESSED, data, 1);
+}
+
+void stub_midi_note(u8 channel, u8 note, u8 velocity, u8 on) {
+    u8 data[4] = { channel, note, velocity, on };
+    event_handler(MIDI_NOTE, data, 4);
+}
+
+
+void stub_midi(const u8 *data, u32 length) {
+    while (length) {
+        u8 count = midi_ring_free(&midi_in);
+        if (count > length) count = length;
+        midi_ring_write(&midi_in, data, count);
+        stub_calls.midi_in += count;
+        data += count;
+        length -= count;
+        process_midi();
+    }
+}
+
+void stub_service_midi(void) {
+    u8 byte;
+    while (midi_ring_read(&midi_out, &byte)) {
+        stub_calls.midi_out++;
+        if (output_callback) output_callback(STUB_OUTPUT_MIDI, byte, 0);
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// timers
+
+u64 get_global_time(void) {
+    return now;
+}
+
+void add_timed_event(u8 index, u16 ms, u8 repeat) {
+    stub_calls.add_timed_event++;
+    if (index >= STUB_TIMER_COUNT) return;
+    if (index >= timer_end) timer_end = index + 1;
+    timers[index].active = 1;
+    timers[index].repeat = repeat;
+    timers[index].interval = ms ? ms : 1;
+    timers[index].due = now + timers[index].interval;
+}
+
+void stop_timed_event(u8 index) {
+    stub_calls.stop_timed_event++;
+    if (index >= STUB_TIMER_COUNT) return;
+    timers[index].active = 0;
+}
+
+void update_timer_interval(u8 index, u16 ms) {
+    if (index >= STUB_TIMER_COUNT) return;
+    timers[index].interval = ms ? ms : 1;
+}
+
+
+// ----------------------------------------------------------------------------
+// outputs
+
+void set_cv(u8 output, u16 value) {
+    stub_calls.set_cv++;
+    if (output_callback) output_callback(STUB_OUTPUT_CV, output, value);
+}
+
+void set_gate(u8 output, u8 on) {
+    stub_calls.set_gate++;
+    if (output_callback) output_callback(STUB_OUTPUT_GATE, output, on);
+}
+
+u16 note_to_pitch(u16 note) {
+    stub_calls.note_to_pitch++;
+    // 14 bit DAC, 10 octaves
+    return (note * 16384UL) / 120;
+}
+
+
+// ----------------------------------------------------------------------------
+// grid
+
+u8 is_grid_connected(void) {
+    return 1;
+}
+
+u8 get_grid_column_count(void) {
+    return GRID_COLUMNS;
+}
+
+u8 get_grid_row_count(void) {
+    return GRID_ROWS;
+}
+
+void clear_all_grid_leds(void) {
+    stub_calls.clear_all_grid_leds++;
+    memset(grid_leds, 0, sizeof(grid_leds));
+}
+
+void set_grid_led(u8 x, u8 y, u8 level) {
+    stub_calls.set_grid_led++;
+    grid_leds[y & 15][x & 15] = level;
+    if (output_callback) output_callback(STUB_OUTPUT_LED, (y & 15) << 4 | (x & 15), level);
+}
+
+void refresh_grid(void) {
+    stub_calls.refresh_grid++;
+    grid_dirty = 1;
+}
+
+
+// ----------------------------------------------------------------------------
+// arc
+
+u8 is_arc_connected(void) {
+    return 1;
+}
+
+u8 get_arc_encoder_count(void) {
+    return 4;
+}
+
+void clear_all_arc_leds(void) {
+}
+
+void set_arc_led(u8 enc, u8 led, u8 level) {
+    stub_calls.set_arc_led++;
+    if (output_callback) output_callback(STUB_OUTPUT_ARC, (enc & 3) << 6 | (led & 63), level);
+}
+
+void refresh_arc(void) {
+    stub_calls.refresh_arc++;
+    arc_dirty = 1;
+}
+
+
+// ----------------------------------------------------------------------------
+// flash
+
+u8 is_flash_new(void) {
+    return 0;
+}
+
+u8 get_preset_count(void) {
+    return STUB_PRESET_COUNT;
+}
+
+u8 get_preset_index(void) {
+    return flash_preset_index;
+}
+
+void store_preset_index(u8 index) {
+    flash_preset_index = index;
+}
+
+void store_shared_data_to_flash(shared_data_t *shared) {
+    stub_calls.store_flash++;
+    memcpy(&flash_shared, shared, sizeof(shared_data_t));
+}
+
+void store_preset_to_flash(u8 index, preset_meta_t *meta, preset_data_t *preset) {
+    stub_calls.store_flash++;
+    if (index >= STUB_PRESET_COUNT) return;
+    memcpy(&flash_meta[index], meta, sizeof(preset_meta_t));
+    memcpy(&flash_presets[index], preset, sizeof(preset_data_t));
+}
+
+void load_shared_data_from_flash(shared_data_t *shared) {
+    stub_calls.load_flash++;
+    memcpy(shared, &flash_shared, sizeof(shared_data_t));
+}
+
+void load_preset_from_flash(u8 index, preset_data_t *preset) {
+    stub_calls.load_flash++;
+    if (index >= STUB_PRESET_COUNT) return;
+    memcpy(preset, &flash_presets[index], sizeof(preset_data_t));
+}
+
+void load_preset_meta_from_flash(u8 index, preset_meta_t *meta) {
+    stub_calls.load_flash++;
+    if (index >= STUB_PRESET_COUNT) return;
+    memcpy(meta, &flash_meta[index], sizeof(preset_meta_t));
+}
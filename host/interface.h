@@ -0,0 +1,71 @@
+// ----------------------------------------------------------------------------
+// host stand-in for multipass interface.h
+//
+// declares the subset of the multipass interface acperience uses. the
+// implementation in interface.c records every call so benchmarks and tools
+// can see what the controller sends to the hardware.
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+#include "control.h"
+
+
+// ----------------------------------------------------------------------------
+// events
+
+#define MAIN_CLOCK_RECEIVED   0
+#define MAIN_CLOCK_SWITCHED   1
+#define GATE_RECEIVED         2
+#define GRID_CONNECTED        3
+#define GRID_KEY_PRESSED      4
+#define GRID_KEY_HELD         5
+#define ARC_ENCODER_COARSE    6
+#define FRONT_BUTTON_PRESSED  7
+#define FRONT_BUTTON_HELD     8
+#define BUTTON_PRESSED        9
+#define I2C_RECEIVED         10
+#define TIMED_EVENT          11
+#define MIDI_CONNECTED       12
+#define MIDI_NOTE            13
+#define MIDI_CC              14
+#define MIDI_AFTERTOUCH      15
+#define ARC_CONNECTED        16
+
+#define MAX_LEVEL 15
+
+
+// ----------------------------------------------------------------------------
+// functions provided by multipass
+
+u64 get_global_time(void);
+void add_timed_event(u8 index, u16 ms, u8 repeat);
+void stop_timed_event(u8 index);
+void update_timer_interval(u8 index, u16 ms);
+
+void set_cv(u8 output, u16 value);
+void set_gate(u8 output, u8 on);
+u16 note_to_pitch(u16 note);
+
+u8 is_grid_connected(void);
+u8 get_grid_column_count(void);
+u8 get_grid_row_count(void);
+void clear_all_grid_leds(void);
+void set_grid_led(u8 x, u8 y, u8 level);
+void refresh_grid(void);
+
+u8 is_arc_connected(void);
+u8 get_arc_encoder_count(void);
+void clear_all_arc_leds(void);
+void set_arc_led(u8 enc, u8 led, u8 level);
+void refresh_arc(void);
+
+u8 is_flash_new(void);
+u8 get_preset_count(void);
+u8 get_preset_index(void);
+void store_preset_index(u8 index);
+void store_shared_data_to_flash(shared_data_t *shared);
+void store_preset_to_flash(u8 index, preset_meta_t *meta, preset_data_t *preset);
+void load_shared_data_from_flash(shared_data_t *shared);
+void load_preset_from_flash(u8 index, preset_data_t *preset);
+void load_preset_meta_from_flash(u8 index, preset_meta_t *meta);
@@ -0,0 +1,180 @@
+// ----------------------------------------------------------------------------
+// acperience midi player
+//
+// feeds a raw midi byte stream through control.c with virtual time, the way
+// main.c would feed a usb midi port, and writes the midi it sends back. the
+// stream is paced by its own clock: every clock tick advances virtual time
+// by one 24th of a quarter note at the given tempo. without an input file a
+// virtual stream of start, clock ticks and stop is played.
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interface.h"
+#include "stub.h"
+
+#define DEFAULT_BPM 120
+#define DEFAULT_STEPS 64
+#define TICKS_PER_STEP 6
+
+static u8 *output;
+static u32 output_length, output_size;
+static u32 note_ons;
+static u64 tick_us, time_us;
+
+
+// ----------------------------------------------------------------------------
+
+// control.c never uses running status, every note on starts with its status
+static void record_output(u8 type, u8 output_byte, u16 value) {
+    if (type != STUB_OUTPUT_MIDI) return;
+    if ((output_byte & 0xF0) == MIDI_NOTE_ON) note_ons++;
+
+    if (output_length == output_size) {
+        output_size = output_size ? output_size << 1 : 4096;
+        output = realloc(output, output_size);
+        if (!output) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    output[output_length++] = output_byte;
+}
+
+// lets virtual time pass up to the next tick, like the main loop would
+static void tick(void) {
+    u64 now = get_global_time();
+    time_us += tick_us;
+    stub_advance_time(time_us / 1000 > now ? time_us / 1000 - now : 0);
+    stub_service_grid();
+    stub_service_midi();
+}
+
+// feeds everything up to and including each clock tick, then lets the tick
+// period pass
+static void play(const u8 *data, u32 length) {
+    u32 start = 0;
+
+    for (u32 i = 0; i < length; i++) {
+        if (data[i] != MIDI_CLOCK) continue;
+        stub_midi(data + start, i + 1 - start);
+        stub_service_midi();
+        tick();
+        start = i + 1;
+    }
+    if (start < length) stub_midi(data + start, length - start);
+    stub_service_midi();
+}
+
+static u8 *virtual_stream(u32 steps, u32 *length) {
+    u32 ticks = steps * TICKS_PER_STEP;
+    u8 *data = malloc(ticks + 2);
+    if (!data) return NULL;
+
+    data[0] = MIDI_START;
+    for (u32 i = 0; i < ticks; i++) data[1 + i] = MIDI_CLOCK;
+    data[1 + ticks] = MIDI_STOP;
+    *length = ticks + 2;
+    return data;
+}
+
+static u8 *read_file(const char *path, u32 *length) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    u8 *data = malloc(size > 0 ? size : 1);
+    if (data && size > 0 && fread(data, size, 1, f) != 1) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+
+    *length = size > 0 ? size : 0;
+    return data;
+}
+
+
+// ----------------------------------------------------------------------------
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: acperience-midi [options]\n"
+        "  -i file   raw midi input, a virtual stream of start, clock and stop otherwise\n"
+        "  -o file   raw midi output\n"
+        "  -b bpm    tempo the input clock is played at, default %u\n"
+        "  -s steps  length of the virtual stream in 16th steps, default %u\n"
+        "  -f file   flash image to play, a generated pattern otherwise\n",
+        DEFAULT_BPM, DEFAULT_STEPS);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *input_path = NULL, *output_path = NULL, *flash_path = NULL;
+    u32 bpm = DEFAULT_BPM, steps = DEFAULT_STEPS, length;
+    struct timespec start, end;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:o:b:s:f:")) != -1) {
+        switch (opt) {
+            case 'i': input_path = optarg; break;
+            case 'o': output_path = optarg; break;
+            case 'b': bpm = strtoul(optarg, NULL, 10); break;
+            case 's': steps = strtoul(optarg, NULL, 10); break;
+            case 'f': flash_path = optarg; break;
+            default: usage();
+        }
+    }
+    if (optind != argc || !bpm || !steps) usage();
+
+    u8 *data = input_path ? read_file(input_path, &length) : virtual_stream(steps, &length);
+    if (!data) {
+        fprintf(stderr, "can't read %s\n", input_path ? input_path : "input");
+        return 1;
+    }
+
+    stub_init();
+    if (!flash_path) {
+        init_presets();
+    } else if (!stub_load_flash(flash_path)) {
+        fprintf(stderr, "can't read %s\n", flash_path);
+        return 1;
+    }
+    init_control();
+    if (!flash_path) {
+        stub_grid_key(2, get_grid_row_count() - 1, 1);
+        stub_grid_key(2, get_grid_row_count() - 1, 0);
+    }
+    stub_service_midi();
+    stub_reset_calls();
+    stub_set_output_callback(record_output);
+
+    tick_us = 60000000ULL / bpm / MIDI_PPQN;
+    time_us = get_global_time() * 1000;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    play(data, length);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(data);
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%u bytes in, %u bytes out, %u notes, %.1f ns per byte in\n", stub_calls.midi_in,
+        stub_calls.midi_out, note_ons, stub_calls.midi_in ? ns / stub_calls.midi_in : 0.0);
+
+    if (output_path) {
+        FILE *f = fopen(output_path, "wb");
+        if (!f || (output_length && fwrite(output, output_length, 1, f) != 1) || fclose(f)) {
+            fprintf(stderr, "can't write %s\n", output_path);
+            return 1;
+        }
+    }
+
+    free(output);
+    return 0;
+}
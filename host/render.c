@@ -0,0 +1,391 @@
+// ----------------------------------------------------------------------------
+// acperience headless renderer
+//
+// plays a preset through control.c as fast as possible, with virtual time
+// standing in for the clock and no grid, and writes the cv and gate outputs
+// as a csv event stream and/or a standard midi file.
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interface.h"
+#include "stub.h"
+
+#define STEPS_PER_BAR 16
+#define DEFAULT_BARS 1000
+#define DEFAULT_CLOCK_PERIOD 125 // 16ths at 120 bpm
+
+#define OUTPUT_COUNT 4
+#define CSV_BUFFER_SIZE 65536
+#define CSV_LINE_SIZE 48
+#define OUTPUT_UNKNOWN 0xFFFF
+
+// midi ticks are milliseconds: 500 ticks per quarter at 500000us per quarter
+#define MIDI_DIVISION 500
+#define MIDI_TEMPO 500000
+#define MIDI_VELOCITY 96
+#define MIDI_VELOCITY_ACCENT 127
+#define NO_NOTE 255
+
+typedef struct {
+    u64 time;
+    u32 order;
+    u8 data[3];
+} midi_event_t;
+
+static FILE *csv;
+static u64 csv_events;
+static char csv_buffer[CSV_BUFFER_SIZE];
+static u32 csv_length;
+static u16 last_value[2][OUTPUT_COUNT];
+
+static u8 midi_on, voice_count;
+static midi_event_t *midi_events;
+static u32 midi_event_count, midi_event_size;
+static u16 cv[OUTPUT_COUNT];
+static u8 gate[OUTPUT_COUNT], note[OUTPUT_COUNT];
+static u8 note_pending[OUTPUT_COUNT], pitch_changed[OUTPUT_COUNT];
+static u64 note_time[OUTPUT_COUNT], change_time[OUTPUT_COUNT];
+
+
+// ----------------------------------------------------------------------------
+// demo preset
+
+// a short acid line in the first pattern, used when no flash image is given
+static void store_demo_preset(void) {
+    static const s8 pitches[STEPS_PER_BAR] = { 0, 0, 12, 0, 3, 5, 0, 7, 0, 10, 0, 3, 15, 0, 5, 3 };
+    static const u8 gates[STEPS_PER_BAR] = { 1, 1, 1, 0, 1, 2, 1, 1, 0, 1, 1, 1, 1, 0, 1, 2 };
+    engine_pattern_t ep;
+    preset_meta_t meta;
+    preset_data_t preset;
+    shared_data_t shared;
+    u16 length = 0;
+
+    init_presets();
+    memset(&preset, 0, sizeof(preset));
+
+    e_init(&ep);
+    for (u8 i = 0; i < STEPS_PER_BAR; i++) {
+        e_set_pitch(&ep, i, pitches[i]);
+        e_set_gate(&ep, i, gates[i]);
+        e_set_accent(&ep, i, (i & 3) == 2);
+        e_set_slide(&ep, i, i == 4 || i == 11);
+    }
+    e_set_ratchet(&ep, 7, 2);
+    e_set_reset(&ep, STEPS_PER_BAR - 1, 1);
+    length += e_encode_pattern(&ep, preset.patterns);
+
+    e_init(&ep);
+    for (u8 i = 1; i < PATTERN_COUNT; i++) length += e_encode_pattern(&ep, preset.patterns + length);
+
+    store_preset_to_flash(0, &meta, &preset);
+
+    load_shared_data_from_flash(&shared);
+    shared.slide_time = 3;
+    store_shared_data_to_flash(&shared);
+}
+
+
+// ----------------------------------------------------------------------------
+// csv
+
+// fprintf takes longer than rendering the event, the lines are put
+// together by hand in a buffer that is written out when it fills up
+static char *put_number(char *p, u64 value) {
+    char digits[20];
+    u8 count = 0;
+
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (count) *p++ = digits[--count];
+    return p;
+}
+
+static void flush_csv(void) {
+    fwrite(csv_buffer, 1, csv_length, csv);
+    csv_length = 0;
+}
+
+static void write_csv(u8 type, u8 output, u16 value) {
+    const char *name = type == STUB_OUTPUT_CV ? ",cv," : ",gate,";
+
+    if (csv_length > CSV_BUFFER_SIZE - CSV_LINE_SIZE) flush_csv();
+    char *p = csv_buffer + csv_length;
+
+    p = put_number(p, get_global_time());
+    while (*name) *p++ = *name++;
+    p = put_number(p, output);
+    *p++ = ',';
+    p = put_number(p, value);
+    *p++ = '\n';
+    csv_length = p - csv_buffer;
+}
+
+
+// ----------------------------------------------------------------------------
+// midi
+
+// each voice plays on its own channel. gate edges become notes, a pitch
+// change while the gate is held (a tie or a slide) becomes a legato note
+// change once the cv has settled at the next clock.
+
+static void add_midi_event(u64 time, u8 status, u8 data1, u8 data2) {
+    if (midi_event_count == midi_event_size) {
+        midi_event_size = midi_event_size ? midi_event_size << 1 : 4096;
+        midi_events = realloc(midi_events, midi_event_size * sizeof(midi_event_t));
+        if (!midi_events) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    midi_event_t *e = &midi_events[midi_event_count];
+    e->time = time;
+    e->order = midi_event_count++;
+    e->data[0] = status;
+    e->data[1] = data1;
+    e->data[2] = data2;
+}
+
+static u8 cv_to_note(u16 value) {
+    u32 n = ((u32)value * 120 + 8192) >> 14;
+    return n > 127 ? 127 : n;
+}
+
+// voice 0 only has an accent output while gate 1 isn't used by voice 1
+static u8 accent_velocity(u8 voice) {
+    return !voice && voice_count < 2 && gate[1] ? MIDI_VELOCITY_ACCENT : MIDI_VELOCITY;
+}
+
+// note ons wait until all outputs of the step are set so the accent is known
+static void flush_notes(u64 time) {
+    for (u8 v = 0; v < voice_count; v++) {
+        if (!note_pending[v] || note_time[v] >= time) continue;
+        note_pending[v] = 0;
+        note[v] = cv_to_note(cv[v]);
+        add_midi_event(note_time[v], 0x90 | v, note[v], accent_velocity(v));
+    }
+}
+
+static void sample_notes(void) {
+    u64 now = get_global_time();
+
+    flush_notes(now + 1);
+    for (u8 v = 0; v < voice_count; v++) {
+        if (!pitch_changed[v]) continue;
+        pitch_changed[v] = 0;
+        if (note[v] == NO_NOTE || cv_to_note(cv[v]) == note[v]) continue;
+        add_midi_event(change_time[v], 0x90 | v, cv_to_note(cv[v]), accent_velocity(v));
+        add_midi_event(change_time[v], 0x80 | v, note[v], 0);
+        note[v] = cv_to_note(cv[v]);
+    }
+}
+
+static void track_midi(u8 type, u8 output, u16 value) {
+    u64 now = get_global_time();
+    u8 voice = output < voice_count;
+
+    flush_notes(now);
+
+    if (type == STUB_OUTPUT_CV) {
+        cv[output] = value;
+        if (voice && note[output] != NO_NOTE && !pitch_changed[output]) {
+            pitch_changed[output] = 1;
+            change_time[output] = now;
+        }
+        return;
+    }
+
+    gate[output] = value;
+    if (!voice) return;
+
+    if (value) {
+        note_pending[output] = 1;
+        note_time[output] = now;
+    } else {
+        flush_notes(now + 1);
+        pitch_changed[output] = 0;
+        if (note[output] != NO_NOTE) add_midi_event(now, 0x80 | output, note[output], 0);
+        note[output] = NO_NOTE;
+    }
+}
+
+static int compare_midi_events(const void *a, const void *b) {
+    const midi_event_t *ea = a, *eb = b;
+    if (ea->time != eb->time) return ea->time < eb->time ? -1 : 1;
+    return ea->order < eb->order ? -1 : ea->order > eb->order;
+}
+
+static void put_vlq(FILE *f, u32 value) {
+    u8 bytes[5];
+    u8 count = 0;
+
+    do {
+        bytes[count++] = value & 0x7F;
+        value >>= 7;
+    } while (value);
+    while (count--) fputc(bytes[count] | (count ? 0x80 : 0), f);
+}
+
+static void put_u32(FILE *f, u32 value) {
+    fputc(value >> 24, f);
+    fputc(value >> 16, f);
+    fputc(value >> 8, f);
+    fputc(value, f);
+}
+
+// format 0, a single track with millisecond ticks
+static u8 write_midi(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+
+    qsort(midi_events, midi_event_count, sizeof(midi_event_t), compare_midi_events);
+
+    fwrite("MThd", 1, 4, f);
+    put_u32(f, 6);
+    fputc(0, f); fputc(0, f);
+    fputc(0, f); fputc(1, f);
+    fputc(MIDI_DIVISION >> 8, f); fputc(MIDI_DIVISION & 0xFF, f);
+
+    fwrite("MTrk", 1, 4, f);
+    long length_position = ftell(f);
+    put_u32(f, 0);
+
+    u8 tempo[] = { 0x00, 0xFF, 0x51, 0x03, MIDI_TEMPO >> 16, (MIDI_TEMPO >> 8) & 0xFF, MIDI_TEMPO & 0xFF };
+    fwrite(tempo, 1, sizeof(tempo), f);
+
+    u64 time = 0;
+    for (u32 i = 0; i < midi_event_count; i++) {
+        put_vlq(f, midi_events[i].time - time);
+        fwrite(midi_events[i].data, 1, 3, f);
+        time = midi_events[i].time;
+    }
+
+    u8 end[] = { 0x00, 0xFF, 0x2F, 0x00 };
+    fwrite(end, 1, sizeof(end), f);
+
+    long end_position = ftell(f);
+    fseek(f, length_position, SEEK_SET);
+    put_u32(f, end_position - length_position - 4);
+
+    return fclose(f) == 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// rendering
+
+static void record_output(u8 type, u8 output, u16 value) {
+    if (type == STUB_OUTPUT_LED || output >= OUTPUT_COUNT || last_value[type][output] == value) return;
+    last_value[type][output] = value;
+
+    csv_events++;
+    if (csv) write_csv(type, output, value);
+    if (midi_on) track_midi(type, output, value);
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: acperience-render [options]\n"
+        "  -f file   flash image to play, a built-in demo preset otherwise\n"
+        "  -p n      preset to play, defaults to the stored preset index\n"
+        "  -b n      bars of %d steps to render, default %d\n"
+        "  -t ms     clock period, default %d\n"
+        "  -c file   write the outputs as csv\n"
+        "  -m file   write the outputs as a standard midi file\n",
+        STEPS_PER_BAR, DEFAULT_BARS, DEFAULT_CLOCK_PERIOD);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *flash_path = NULL, *csv_path = NULL, *midi_path = NULL;
+    int preset_index = -1, opt;
+    u32 bars = DEFAULT_BARS, clock_period = DEFAULT_CLOCK_PERIOD;
+    shared_data_t shared;
+    struct timespec start, end;
+
+    while ((opt = getopt(argc, argv, "f:p:b:t:c:m:")) != -1) {
+        switch (opt) {
+            case 'f': flash_path = optarg; break;
+            case 'p': preset_index = atoi(optarg); break;
+            case 'b': bars = strtoul(optarg, NULL, 10); break;
+            case 't': clock_period = strtoul(optarg, NULL, 10); break;
+            case 'c': csv_path = optarg; break;
+            case 'm': midi_path = optarg; break;
+            default: usage();
+        }
+    }
+    if (optind < argc || !bars || clock_period < 2 || preset_index >= STUB_PRESET_COUNT) usage();
+
+    stub_init();
+    if (flash_path) {
+        if (!stub_load_flash(flash_path)) {
+            fprintf(stderr, "can't read %s\n", flash_path);
+            return 1;
+        }
+    } else {
+        store_demo_preset();
+    }
+    if (preset_index >= 0) store_preset_index(preset_index);
+
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            fprintf(stderr, "can't write %s\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "time_ms,type,output,value\n");
+    }
+
+    load_shared_data_from_flash(&shared);
+    voice_count = shared.voice_count && shared.voice_count <= OUTPUT_COUNT ? shared.voice_count : 1;
+    midi_on = midi_path != NULL;
+    memset(last_value, 0xFF, sizeof(last_value));
+    memset(note, NO_NOTE, sizeof(note));
+
+    init_control();
+    stub_set_output_callback(record_output);
+
+    // the frame timer only draws the grid and arc and notices a stopped
+    // clock, which never happens here. without it virtual time jumps from
+    // one clock edge to the next unless sub-step events are pending.
+    stop_timed_event(TIMER_RENDER);
+
+    u64 steps = (u64)bars * STEPS_PER_BAR;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (u64 i = 0; i < steps; i++) {
+        if (midi_on) sample_notes();
+        stub_clock(1);
+        stub_advance_time(clock_period >> 1);
+        stub_clock(0);
+        stub_advance_time(clock_period - (clock_period >> 1));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (midi_on) {
+        sample_notes();
+        for (u8 v = 0; v < voice_count; v++)
+            if (note[v] != NO_NOTE) add_midi_event(get_global_time(), 0x80 | v, note[v], 0);
+        if (!write_midi(midi_path)) {
+            fprintf(stderr, "can't write %s\n", midi_path);
+            return 1;
+        }
+    }
+    if (csv) flush_csv();
+    if (csv && fclose(csv)) {
+        fprintf(stderr, "can't write %s\n", csv_path);
+        return 1;
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%llu steps, %llu events in %.3f s, %.0f steps/s\n",
+        (unsigned long long)steps, (unsigned long long)csv_events, seconds, steps / seconds);
+
+    return 0;
+}
@@ -0,0 +1,266 @@
+// ----------------------------------------------------------------------------
+// acperience event replay
+//
+// replays an event log (see evlog.h) through control.c with virtual time,
+// then prints how long each event type took and a hash of every set_cv,
+// set_gate, set_grid_led and set_arc_led call. two builds that print the
+// same hash for a log behaved the same. it can also generate a random session to replay.
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "interface.h"
+#include "stub.h"
+
+#define EVENT_TYPES 17
+#define PROFILE_RENDER EVENT_TYPES
+#define PROFILE_MIDI (EVENT_TYPES + 1)
+#define PROFILE_COUNT (EVENT_TYPES + 2)
+
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME 16777619UL
+
+typedef struct {
+    u64 count;
+    u64 total;
+    u32 worst;
+} profile_t;
+
+static const char *profile_names[PROFILE_COUNT] = {
+    "clock", "clock switched", "gate", "grid connected", "grid key",
+    "grid key held", "arc encoder", "front button", "front button held",
+    "button", "i2c", "timer", "midi connected", "midi note", "midi cc",
+    "midi aftertouch", "arc connected", "render", "midi bytes"
+};
+
+static profile_t profiles[PROFILE_COUNT];
+static u32 output_hash = FNV_OFFSET;
+static u64 output_count;
+static u32 random_state;
+
+
+// ----------------------------------------------------------------------------
+// profiling and hashing
+
+static void hash_byte(u8 byte) {
+    output_hash = (output_hash ^ byte) * FNV_PRIME;
+}
+
+static void hash_output(u8 type, u8 output, u16 value) {
+    hash_byte(type);
+    hash_byte(output);
+    hash_byte(value);
+    hash_byte(value >> 8);
+    output_count++;
+}
+
+static void profile(u8 index, u32 start) {
+    u32 cycles = get_cycles() - start;
+    profiles[index].count++;
+    profiles[index].total += cycles;
+    if (cycles > profiles[index].worst) profiles[index].worst = cycles;
+}
+
+static void profiled_event(u8 event, u8 *data, u8 length) {
+    u32 start = get_cycles();
+    process_event(event, data, length);
+    profile(event < EVENT_TYPES ? event : TIMED_EVENT, start);
+}
+
+// lets time pass and renders the grid and arc if asked to, like the main
+// loop
+static void advance(u32 ms) {
+    stub_advance_time(ms);
+    u32 start = get_cycles();
+    stub_service_grid();
+    stub_service_arc();
+    if (stub_calls.render_grid || stub_calls.render_arc) profile(PROFILE_RENDER, start);
+    stub_reset_calls();
+}
+
+
+// ----------------------------------------------------------------------------
+// session generator
+
+static u32 next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// mostly clock pulses and tracker edits, with the occasional page, preset
+// and pattern change, midi note, preset save and grid reconnect. every event is
+// preceded by exactly one advance so replay sees the same render points.
+// the diagnostics page shows measured times that differ from run to run,
+// so the tracker key is never pressed while already on the tracker.
+static void generate_session(u32 gestures) {
+    u16 period = 40 + next_random() % 160;
+    u8 on_tracker = 1;
+
+    for (u32 i = 0; i < gestures; i++) {
+        u32 r = next_random() % 100;
+
+        if (r < 55) {
+            advance(period >> 1);
+            stub_clock(1);
+            advance(period - (period >> 1));
+            stub_clock(0);
+        } else if (r < 93) {
+            u32 column = next_random() % 100;
+            u8 x = column < 65 ? 8 + next_random() % 8 : column < 90 ? 2 + next_random() % 6 : next_random() % 2;
+            u8 y = next_random() % 8;
+            if (x == 0 && y >= 5) {
+                if (y == 6 && on_tracker) y = 5;
+                on_tracker = y == 6;
+            }
+            advance(next_random() % 20);
+            stub_grid_key(x, y, 1);
+            advance(next_random() % 200);
+            stub_grid_key(x, y, 0);
+        } else if (r < 95) {
+            period = 40 + next_random() % 160;
+        } else if (r < 97) {
+            // the note off uses running status
+            u8 on[3] = { MIDI_NOTE_ON, 36 + next_random() % 36, 100 }, off[2] = { on[1], 0 };
+            advance(next_random() % 20);
+            stub_midi(on, 3);
+            advance(next_random() % 200);
+            stub_midi(off, 2);
+        } else if (r < 99) {
+            advance(next_random() % 20);
+            stub_front_button(1);
+            advance(50);
+            stub_front_button(0);
+        } else {
+            advance(next_random() % 20);
+            stub_grid_connected();
+        }
+    }
+    advance(0);
+}
+
+
+// ----------------------------------------------------------------------------
+
+static u8 *read_file(const char *path, u32 *length) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    u8 *data = size > 0 ? malloc(size) : NULL;
+    if (data && fread(data, size, 1, f) != 1) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+
+    *length = size;
+    return data;
+}
+
+static void replay(u8 *log, u32 length) {
+    evlog_reader_t reader;
+    u8 event, data[EVLOG_MAX_DATA], data_length;
+
+    if (!evlog_reader_init(&reader, log, length)) {
+        fprintf(stderr, "not an event log\n");
+        exit(1);
+    }
+
+    while (evlog_next(&reader, &event, data, &data_length)) {
+        advance(reader.time > get_global_time() ? reader.time - get_global_time() : 0);
+        if (event == EVLOG_MIDI) {
+            u32 start = get_cycles();
+            stub_midi(data, data_length);
+            profile(PROFILE_MIDI, start);
+        } else {
+            profiled_event(event, data, data_length);
+        }
+    }
+    advance(0);
+
+    if (reader.position != reader.length) fprintf(stderr, "log ends with a truncated record\n");
+}
+
+static void print_profiles(void) {
+    printf("%-18s %10s %12s %10s %10s\n", "event", "count", "total us", "mean ns", "worst ns");
+    for (u8 i = 0; i < PROFILE_COUNT; i++) {
+        profile_t *p = &profiles[i];
+        if (!p->count) continue;
+        printf("%-18s %10llu %12.1f %10.1f %10.1f\n", profile_names[i], (unsigned long long)p->count,
+            p->total / (double)CYCLES_PER_US, p->total * 1000.0 / CYCLES_PER_US / p->count,
+            p->worst * 1000.0 / CYCLES_PER_US);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: acperience-replay [options] log\n"
+        "  -f file   flash image to start from, freshly initialized presets otherwise\n"
+        "  -g n      record a random session of n gestures to log instead of replaying\n"
+        "  -s seed   seed for -g, default 1\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    const char *flash_path = NULL;
+    u32 gestures = 0, length;
+    int opt;
+
+    random_state = 1;
+    while ((opt = getopt(argc, argv, "f:g:s:")) != -1) {
+        switch (opt) {
+            case 'f': flash_path = optarg; break;
+            case 'g': gestures = strtoul(optarg, NULL, 10); break;
+            case 's': random_state = strtoul(optarg, NULL, 10); break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 1 || !random_state) usage();
+    const char *log_path = argv[optind];
+
+    stub_init();
+    if (!flash_path) {
+        init_presets();
+    } else if (!stub_load_flash(flash_path)) {
+        fprintf(stderr, "can't read %s\n", flash_path);
+        return 1;
+    }
+    init_control();
+    stub_set_output_callback(hash_output);
+
+    evlog_t *log = get_event_log();
+
+    if (gestures) {
+        generate_session(gestures);
+        if (!log->recording) fprintf(stderr, "event log full, the session was cut short\n");
+
+        FILE *f = fopen(log_path, "wb");
+        if (!f || fwrite(log->data, log->length, 1, f) != 1 || fclose(f)) {
+            fprintf(stderr, "can't write %s\n", log_path);
+            return 1;
+        }
+        printf("recorded %u bytes\n", log->length);
+    } else {
+        u8 *data = read_file(log_path, &length);
+        if (!data) {
+            fprintf(stderr, "can't read %s\n", log_path);
+            return 1;
+        }
+
+        evlog_stop(log);
+        stub_set_event_handler(profiled_event);
+        replay(data, length);
+        free(data);
+        print_profiles();
+    }
+
+    printf("%llu outputs, hash %08x\n", (unsigned long long)output_count, output_hash);
+    return 0;
+}
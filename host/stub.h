@@ -0,0 +1,98 @@
+// ----------------------------------------------------------------------------
+// host stub controls
+//
+// lets host tools inspect the calls control.c makes into multipass, drive
+// virtual time and service grid refreshes the way the main loop would.
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+
+#define STUB_PRESET_COUNT 8
+#define STUB_TIMER_COUNT 16
+
+#define STUB_OUTPUT_CV   0
+#define STUB_OUTPUT_GATE 1
+#define STUB_OUTPUT_LED  2 // output is y << 4 | x
+#define STUB_OUTPUT_MIDI 3 // output is the byte sent
+#define STUB_OUTPUT_ARC  4 // output is encoder << 6 | led
+
+// called for every set_cv, set_gate, set_grid_led and set_arc_led and
+// every midi byte sent so tools can record the outputs
+typedef void (*stub_output_callback_t)(u8 type, u8 output, u16 value);
+
+// every event the stub sends goes through this, process_event by default
+typedef void (*stub_event_handler_t)(u8 event, u8 *data, u8 length);
+
+typedef struct {
+    u32 set_cv;
+    u32 set_gate;
+    u32 note_to_pitch;
+    u32 set_grid_led;
+    u32 clear_all_grid_leds;
+    u32 refresh_grid;
+    u32 render_grid;
+    u32 set_arc_led;
+    u32 refresh_arc;
+    u32 render_arc;
+    u32 add_timed_event;
+    u32 stop_timed_event;
+    u32 store_flash;
+    u32 load_flash;
+    u32 midi_in;
+    u32 midi_out;
+} stub_calls_t;
+
+extern stub_calls_t stub_calls;
+
+void stub_init(void);
+void stub_reset_calls(void);
+void stub_set_output_callback(stub_output_callback_t callback);
+void stub_set_event_handler(stub_event_handler_t handler);
+
+// saves or loads all presets, shared data and the preset index as one
+// binary image, returns 0 if the file can't be written or read
+u8 stub_save_flash(const char *path);
+u8 stub_load_flash(const char *path);
+
+// renders the grid if refresh_grid() was called since the last service,
+// same as the multipass main loop does
+void stub_service_grid(void);
+
+// advances virtual time, firing any timed events that become due
+void stub_advance_time(u32 ms);
+
+// 1 while the timed event with the given index is running
+u8 stub_timer_active(u8 index);
+
+// sends a clock edge through process_event
+void stub_clock(u8 on);
+
+// sends a grid key through process_event
+void stub_grid_key(u8 x, u8 y, u8 pressed);
+
+// sends a grid (re)connection through process_event
+void stub_grid_connected(void);
+
+// renders the arc if refresh_arc() was called since the last service
+void stub_service_arc(void);
+
+// sends one coarse encoder step through process_event, data[1] is 1 for
+// clockwise like multipass sends it
+void stub_arc_encoder(u8 encoder, u8 clockwise);
+
+// sends an arc (re)connection through process_event
+void stub_arc_connected(void);
+
+// sends a front button press or release through process_event
+void stub_front_button(u8 pressed);
+
+// sends a note through process_event like a main.c without midi bytes
+void stub_midi_note(u8 channel, u8 note, u8 velocity, u8 on);
+
+// writes bytes to midi_in and calls process_midi whenever the ring fills
+// up and once at the end, like the main loop after a usb transfer
+void stub_midi(const u8 *data, u32 length);
+
+// sends what control.c left in midi_out to the output callback
+void stub_service_midi(void);
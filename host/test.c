@@ -0,0 +1,1162 @@
+// ----------------------------------------------------------------------------
+// acperience behaviour tests
+//
+// checks the modules in ../src on their own, and control.c through the stub
+// the way main.c drives it, one section each. prints every failed check and
+// exits with 1 if there was any.
+// ----------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface.h"
+#include "stub.h"
+#include "wheel.h"
+#include "slide.h"
+#include "history.h"
+#include "tempo.h"
+
+#define ROUND_TRIPS 1000
+#define MAX_MESSAGES 16
+#define MAX_OUTPUTS 4096
+#define MAX_FIRED 64
+#define MAX_CHANGES 64
+#define AUTOSAVE_WAIT 3000 // ms after the last edit autosave has written everything
+
+// the pattern the tracker shows and the undo history of control.c
+extern engine_pattern_t *pattern;
+extern history_t history;
+
+static u32 failures;
+static u32 random_state = 1;
+
+#define check(condition, ...) do { if (!(condition)) { failures++; printf("FAIL %s: ", __func__); printf(__VA_ARGS__); printf("\n"); } } while (0)
+
+static u32 next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+
+// ----------------------------------------------------------------------------
+// playing patterns
+
+typedef struct {
+    u64 time;
+    u8 type;
+    u8 output;
+    u16 value;
+} output_t;
+
+static output_t outputs[MAX_OUTPUTS];
+static u32 output_count;
+
+static void record_output(u8 type, u8 output, u16 value) {
+    if ((type != STUB_OUTPUT_CV && type != STUB_OUTPUT_GATE) || output_count == MAX_OUTPUTS) return;
+    output_t *o = &outputs[output_count++];
+    o->time = get_global_time();
+    o->type = type;
+    o->output = output;
+    o->value = value;
+}
+
+static void default_settings(shared_data_t *settings) {
+    init_presets();
+    load_shared_data_from_flash(settings);
+}
+
+// starts control.c on preset 0 holding the given patterns and settings and
+// records cv and gate outputs from then on
+static void start(engine_pattern_t *first, u8 count, shared_data_t *settings) {
+    static preset_data_t preset;
+    static engine_pattern_t empty;
+    preset_meta_t meta;
+    u16 length = 0;
+
+    stub_init();
+    init_presets();
+    e_init(&empty);
+    for (u8 i = 0; i < PATTERN_COUNT; i++)
+        length += e_encode_pattern(i < count ? &first[i] : &empty, preset.patterns + length);
+    store_preset_to_flash(0, &meta, &preset);
+    if (settings) store_shared_data_to_flash(settings);
+
+    init_control();
+    output_count = 0;
+    stub_set_output_callback(record_output);
+}
+
+// clock pulses that are high for the first half of the period
+static void send_clock(u16 period, u32 pulses) {
+    while (pulses--) {
+        stub_clock(1);
+        stub_advance_time(period >> 1);
+        stub_clock(0);
+        stub_advance_time(period - (period >> 1));
+    }
+}
+
+// what an output was last set to at the given time, 0xFFFF if never
+static u16 get_output(u8 type, u8 output, u64 time) {
+    u16 value = 0xFFFF;
+
+    for (u32 i = 0; i < output_count && outputs[i].time <= time; i++)
+        if (outputs[i].type == type && outputs[i].output == output) value = outputs[i].value;
+    return value;
+}
+
+// the times an output changed between from and to, returns how many
+static u8 get_changes(u8 type, u8 output, u64 from, u64 to, u64 *times, u8 max) {
+    u16 value = 0xFFFF;
+    u8 count = 0;
+
+    for (u32 i = 0; i < output_count; i++) {
+        output_t *o = &outputs[i];
+        if (o->type != type || o->output != output) continue;
+        if (o->time >= from && o->time < to && o->value != value && count < max) times[count++] = o->time;
+        value = o->value;
+    }
+    return count;
+}
+
+
+// ----------------------------------------------------------------------------
+// midi parser
+
+static midi_message_t messages[MAX_MESSAGES];
+static u8 message_count;
+
+// feeds the bytes in pieces of the given size, 0 feeds them all at once
+static void parse(midi_parser_t *p, const u8 *data, u8 length, u8 piece) {
+    midi_ring_t r;
+    midi_message_t m;
+
+    midi_ring_init(&r);
+    message_count = 0;
+    if (!piece) piece = length;
+
+    for (u8 i = 0; i < length; i += piece) {
+        midi_ring_write(&r, data + i, length - i < piece ? length - i : piece);
+        while (midi_parse(p, &r, &m))
+            if (message_count < MAX_MESSAGES) messages[message_count++] = m;
+    }
+}
+
+static u8 is_message(u8 index, u8 status, u8 data1, u8 data2) {
+    midi_message_t *m = &messages[index];
+    return index < message_count && m->status == status && m->data1 == data1 && m->data2 == data2;
+}
+
+static void test_running_status(void) {
+    const u8 data[] = { 0x90, 60, 100, 62, 90, 64, 0 };
+    midi_parser_t p;
+
+    for (u8 piece = 0; piece < 4; piece++) {
+        midi_parser_init(&p);
+        parse(&p, data, sizeof(data), piece);
+        check(message_count == 3, "%u messages fed %u at a time", message_count, piece);
+        check(is_message(0, 0x90, 60, 100) && is_message(1, 0x90, 62, 90) && is_message(2, 0x90, 64, 0),
+            "wrong notes fed %u at a time", piece);
+    }
+}
+
+static void test_realtime_inside_message(void) {
+    const u8 data[] = { 0x90, 60, MIDI_CLOCK, 100, 62, MIDI_START, 90 };
+    midi_parser_t p;
+
+    midi_parser_init(&p);
+    parse(&p, data, sizeof(data), 0);
+    check(message_count == 4, "%u messages", message_count);
+    check(is_message(0, MIDI_CLOCK, 0, 0) && is_message(1, 0x90, 60, 100), "clock or first note wrong");
+    check(is_message(2, MIDI_START, 0, 0) && is_message(3, 0x90, 62, 90), "start or second note wrong");
+}
+
+static void test_sysex_skipped(void) {
+    const u8 data[] = { 0x90, 60, 100, MIDI_SYSEX, 1, 2, MIDI_CLOCK, 3, MIDI_SYSEX_END, 62, 90, 0x80, 60, 0 };
+    midi_parser_t p;
+
+    midi_parser_init(&p);
+    parse(&p, data, sizeof(data), 0);
+
+    // the end of the sysex cancels running status, so 62 90 is dropped
+    check(message_count == 3, "%u messages", message_count);
+    check(is_message(0, 0x90, 60, 100), "note before the sysex wrong");
+    check(is_message(1, MIDI_CLOCK, 0, 0), "clock inside the sysex lost");
+    check(is_message(2, 0x80, 60, 0), "note off after the sysex wrong");
+}
+
+static void test_system_common_cancels_running_status(void) {
+    const u8 data[] = { 0x90, 60, 100, 0xF3, 5, 62, 90 };
+    midi_parser_t p;
+
+    midi_parser_init(&p);
+    parse(&p, data, sizeof(data), 0);
+    check(message_count == 2, "%u messages", message_count);
+    check(is_message(0, 0x90, 60, 100) && is_message(1, 0xF3, 5, 0), "wrong messages");
+}
+
+static u8 gate_0;
+
+static void record_gate(u8 type, u8 output, u16 value) {
+    if (type == STUB_OUTPUT_GATE && output == 0) gate_0 = value;
+}
+
+// with the sequencer stopped a note opens gate 0 the way the keyboard does
+static void test_note_on_with_velocity_0(void) {
+    const u8 on[] = { 0x90, LOWEST_NOTE, 100 }, off[] = { LOWEST_NOTE, 0 };
+
+    stub_init();
+    init_presets();
+    init_control();
+    stub_grid_key(0, 0, 1);
+    stub_grid_key(0, 0, 0);
+    stub_set_output_callback(record_gate);
+
+    gate_0 = 0;
+    stub_midi(on, sizeof(on));
+    check(gate_0, "note on didn't open the gate");
+    stub_midi(off, sizeof(off));
+    check(!gate_0, "note on with velocity 0 under running status didn't close the gate");
+
+    stub_midi_note(0, LOWEST_NOTE, 100, 1);
+    check(gate_0, "MIDI_NOTE event didn't open the gate");
+    stub_midi_note(0, LOWEST_NOTE, 0, 1);
+    check(!gate_0, "MIDI_NOTE event with velocity 0 didn't close the gate");
+
+    stub_set_output_callback(NULL);
+}
+
+
+// ----------------------------------------------------------------------------
+// pattern encoding
+
+static void random_pattern(engine_pattern_t *ep) {
+    step_t s;
+    u8 density = next_random() % 101;
+
+    e_init(ep);
+    for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++) {
+        if (next_random() % 100 >= density) continue;
+        s.gate = next_random() % (GATE_TIE + 1);
+        s.accent = next_random() & 1;
+        s.slide = next_random() & 1;
+        s.transpose = next_random() % (TRANSPOSE_DOWN + 1);
+        s.is_reset = next_random() % 8 == 0;
+        s.pitch = next_random() % (MAX_PITCH_VALUE + 1);
+        s.ratchet = 1 + next_random() % MAX_RATCHETS;
+        e_set_step(ep, i, &s);
+    }
+}
+
+static u8 same_steps(engine_pattern_t *a, engine_pattern_t *b) {
+    return !memcmp(&a->p, &b->p, sizeof(pattern_t)) && !memcmp(&a->pi, &b->pi, sizeof(pitch_index_t));
+}
+
+static void test_round_trip(void) {
+    static engine_pattern_t a, b;
+    u8 data[ENCODED_PATTERN_MAX_SIZE];
+
+    for (u32 i = 0; i < ROUND_TRIPS; i++) {
+        random_pattern(&a);
+        u8 length = e_encode_pattern(&a, data);
+        check(length <= ENCODED_PATTERN_MAX_SIZE, "encoded %u bytes", length);
+        check(e_decode_pattern(&b, data, length) == length, "round trip %u didn't decode", i);
+        check(same_steps(&a, &b), "round trip %u changed the pattern", i);
+        if (failures) return;
+    }
+}
+
+static void test_empty_pattern(void) {
+    static engine_pattern_t a, b;
+    u8 data[ENCODED_PATTERN_MAX_SIZE];
+
+    e_init(&a);
+    u8 length = e_encode_pattern(&a, data);
+    check(length < 8, "an empty pattern took %u bytes", length);
+    check(e_decode_pattern(&b, data, length) == length && same_steps(&a, &b), "empty pattern didn't round trip");
+}
+
+static void test_malformed(void) {
+    static engine_pattern_t a, b;
+    u8 data[ENCODED_PATTERN_MAX_SIZE];
+
+    e_init(&a);
+    e_set_gate(&a, 0, GATE_ON);
+    e_set_pitch(&a, 0, 5);
+    u8 length = e_encode_pattern(&a, data);
+
+    // the first step token follows the version byte, its pitch after it
+    struct { u8 offset, value; const char *name; } cases[] = {
+        { 0, 0, "version 0" },
+        { 0, PATTERN_ENCODING_VERSION + 1, "a newer version" },
+        { 1, data[1] | 3, "gate 3" },
+        { 1, data[1] | 3 << 4, "transpose 3" },
+        { 2, MAX_PITCH_VALUE + 1, "a pitch out of range" },
+    };
+
+    for (u8 i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        u8 copy[ENCODED_PATTERN_MAX_SIZE];
+        memcpy(copy, data, length);
+        copy[cases[i].offset] = cases[i].value;
+        check(!e_decode_pattern(&b, copy, length), "decoded %s", cases[i].name);
+    }
+
+    for (u8 cut = 0; cut < length; cut++)
+        check(!e_decode_pattern(&b, data, cut), "decoded a pattern cut to %u bytes", cut);
+}
+
+
+// ----------------------------------------------------------------------------
+// timing wheel
+
+static u16 fired_at[MAX_FIRED];
+static u16 ticks;
+static wheel_t *fired_wheel;
+
+static void record_fired(u8 type, u8 data) {
+    fired_at[data] = ticks;
+
+    // type 1 comes around again a whole wheel later
+    if (type == 1) wheel_schedule(fired_wheel, WHEEL_SLOTS, 0, data + 1);
+}
+
+static void advance_wheel(wheel_t *w, u16 count) {
+    while (count--) {
+        ticks++;
+        wheel_advance(w, record_fired);
+    }
+}
+
+// events fire on the tick they were scheduled for wherever the wheel is,
+// including those further away than one turn
+static void test_wheel_schedule(void) {
+    const u16 delays[] = { 0, 1, 2, WHEEL_SLOTS - 1, WHEEL_SLOTS, WHEEL_SLOTS + 1, 3 * WHEEL_SLOTS + 5, WHEEL_MAX_TICKS + 100 };
+    const u8 count = sizeof(delays) / sizeof(delays[0]);
+    wheel_t w;
+
+    for (u16 offset = 0; offset < WHEEL_SLOTS * 2; offset += 7) {
+        wheel_init(&w);
+        ticks = 0;
+        advance_wheel(&w, offset);
+        memset(fired_at, 0, sizeof(fired_at));
+
+        for (u8 i = 0; i < count; i++) check(wheel_schedule(&w, delays[i], 0, i), "event %u not scheduled", i);
+        check(wheel_count(&w) == count, "%u events pending", wheel_count(&w));
+
+        advance_wheel(&w, WHEEL_MAX_TICKS + 1);
+        for (u8 i = 0; i < count; i++) {
+            u16 expected = offset + (!delays[i] ? 1 : delays[i] > WHEEL_MAX_TICKS ? WHEEL_MAX_TICKS : delays[i]);
+            check(fired_at[i] == expected, "delay %u from %u fired at %u, not %u", delays[i], offset, fired_at[i], expected);
+        }
+        check(!wheel_count(&w), "%u events left", wheel_count(&w));
+    }
+}
+
+// the pool runs out instead of allocating, and events scheduled while
+// firing land a whole turn later rather than on the tick being fired
+static void test_wheel_pool(void) {
+    wheel_t w;
+
+    wheel_init(&w);
+    ticks = 0;
+    for (u8 i = 0; i < WHEEL_EVENTS; i++) wheel_schedule(&w, 1 + i, 0, i);
+    check(!wheel_schedule(&w, 1, 0, WHEEL_EVENTS), "scheduled more than %u events", WHEEL_EVENTS);
+
+    advance_wheel(&w, 1);
+    check(wheel_schedule(&w, 1, 0, WHEEL_EVENTS), "a fired event wasn't freed");
+
+    wheel_clear(&w);
+    check(!wheel_count(&w), "clear left events");
+    fired_wheel = &w;
+    wheel_schedule(&w, 3, 1, 0);
+    advance_wheel(&w, 3 + WHEEL_SLOTS);
+    check(fired_at[0] == ticks - WHEEL_SLOTS && fired_at[1] == ticks, "rescheduled event fired at %u, not %u", fired_at[1], ticks);
+}
+
+// ratchets split the step into even gates and the wheel timer only runs
+// while they are pending
+static void test_wheel_ratchets(void) {
+    const u16 period = 120;
+    static engine_pattern_t ep;
+    u64 times[8], start_time;
+
+    e_init(&ep);
+    for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++) {
+        e_set_gate(&ep, i, GATE_ON);
+        e_set_ratchet(&ep, i, 3);
+    }
+    start(&ep, 1, NULL);
+    send_clock(period, 4);
+
+    start_time = get_global_time();
+    stub_clock(1);
+    check(stub_timer_active(TIMER_WHEEL), "wheel timer not running");
+    stub_advance_time(period >> 1);
+    stub_clock(0);
+    stub_advance_time(period >> 1);
+    check(!stub_timer_active(TIMER_WHEEL), "wheel timer still running");
+
+    u8 count = get_changes(STUB_OUTPUT_GATE, 0, start_time, start_time + period, times, 8);
+    check(count == 6, "%u gate changes", count);
+    for (u8 i = 0; i < count && i < 6; i++)
+        check(times[i] == start_time + i * 20, "gate change %u at %llu, not %llu",
+            i, (unsigned long long)(times[i] - start_time), (unsigned long long)i * 20);
+}
+
+
+// ----------------------------------------------------------------------------
+// slides
+
+// the curve table was taken from exp(-4t), scaled to run from 1 to 0
+static double slide_formula(double t) {
+    return (exp(-4 * t) - exp(-4)) / (1 - exp(-4));
+}
+
+// over SLIDE_CURVE_SIZE updates each update reads the next table entry
+static void test_slide_curve(void) {
+    const u16 from = 60000, to = 1000;
+    slide_t s;
+
+    slide_start(&s, from, to, SLIDE_CURVE_SIZE);
+    for (u8 i = 1; i < SLIDE_CURVE_SIZE; i++) {
+        u16 value = slide_update(&s);
+        double expected = to + (from - to) * slide_formula(i / (double)(SLIDE_CURVE_SIZE - 1));
+        check(fabs(value - expected) <= (from - to) / 32767.0 + 1, "update %u is %u, the formula gives %.1f", i, value, expected);
+    }
+    check(slide_update(&s) == to && !s.active, "slide didn't end on the target");
+}
+
+// slides of any length and direction end on the target and never move away
+// from it. the phase steps are whole, so a length that doesn't divide the
+// curve takes one update more.
+static void test_slide_lengths(void) {
+    const u16 lengths[] = { 1, 20, 60, 240 }, ends[][2] = { { 0, 16383 }, { 16383, 0 }, { 500, 501 } };
+
+    for (u8 l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+        for (u8 e = 0; e < sizeof(ends) / sizeof(ends[0]); e++) {
+            u16 from = ends[e][0], to = ends[e][1], last = from, count = 0;
+            slide_t s;
+
+            slide_start(&s, from, to, lengths[l]);
+            while (s.active && count <= lengths[l]) {
+                u16 value = slide_update(&s);
+                count++;
+                check(to > from ? value >= last && value <= to : value <= last && value >= to,
+                    "%u to %u over %u moved from %u to %u", from, to, lengths[l], last, value);
+                last = value;
+            }
+            check((count == lengths[l] || count == lengths[l] + 1) && last == to, "%u to %u over %u took %u updates to reach %u",
+                from, to, lengths[l], count, last);
+        }
+
+    slide_t s;
+    slide_start(&s, 700, 700, 20);
+    check(!s.active, "a slide to where it is started");
+}
+
+// the slide timer runs while cv 0 glides and not when the next step is at
+// the same pitch
+static void test_slide_timer(void) {
+    const u16 period = 200, slide_ms = 60;
+    static engine_pattern_t ep;
+    shared_data_t settings;
+    u64 times[MAX_CHANGES];
+
+    default_settings(&settings);
+    settings.slide_time = 3;
+
+    for (u8 glide = 0; glide < 2; glide++) {
+        e_init(&ep);
+        for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++) {
+            e_set_gate(&ep, i, GATE_ON);
+            e_set_slide(&ep, i, 1);
+            e_set_pitch(&ep, i, glide && (i & 1) ? 12 : 5);
+        }
+        start(&ep, 1, &settings);
+        send_clock(period, 4);
+
+        u64 start_time = get_global_time();
+        stub_reset_calls();
+        stub_clock(1);
+        check(stub_timer_active(TIMER_SLIDE) == glide, "slide timer %s", glide ? "not running" : "running");
+        stub_advance_time(slide_ms + 1);
+        check(!stub_timer_active(TIMER_SLIDE), "slide timer still running after %u ms", slide_ms);
+        stub_advance_time((period >> 1) - slide_ms - 1);
+        stub_clock(0);
+        stub_advance_time(period >> 1);
+
+        u8 count = get_changes(STUB_OUTPUT_CV, 0, start_time, start_time + period, times, MAX_CHANGES);
+        if (glide) check(count > 1 && times[count - 1] <= start_time + slide_ms + 1, "glide took %u changes, the last at %llu",
+            count, (unsigned long long)(times[count - 1] - start_time));
+        else check(!count && stub_calls.add_timed_event == 0, "%u cv changes and %u timers without a glide",
+            count, stub_calls.add_timed_event);
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// voices
+
+// a voice given another pattern picks up that pattern's position, the same
+// pattern again leaves the voice where it is
+static void test_voice_patterns(void) {
+    static engine_pattern_t a, b;
+    engine_voices_t ev;
+
+    e_init(&a);
+    e_init(&b);
+    e_set_current_step(&b, 5);
+    e_init_voices(&ev, 2);
+    e_set_voice_pattern(&ev, 0, &a);
+    e_set_voice_pattern(&ev, 1, &a);
+
+    e_step_all(&ev);
+    e_step_all(&ev);
+    u16 revision = ev.revision;
+    e_set_voice_pattern(&ev, 1, &a);
+    check(e_get_voice_step(&ev, 1) == 2 && ev.revision == revision, "the same pattern moved the voice");
+
+    e_set_voice_pattern(&ev, 1, &b);
+    check(e_get_voice_step(&ev, 1) == 5 && ev.revision != revision, "a new pattern didn't take its position");
+    e_step_all(&ev);
+    check(e_get_current_step(&b) == 6 && e_get_voice_step(&ev, 0) == 3, "voices didn't step on their own");
+}
+
+// each voice wraps at its own length and resets
+static void test_voice_lengths(void) {
+    static engine_pattern_t a, b;
+    engine_voices_t ev;
+    u8 wrapped = 0;
+
+    e_init(&a);
+    e_init(&b);
+    e_set_reset(&b, 2, 1);
+    e_init_voices(&ev, 2);
+    e_set_voice_pattern(&ev, 0, &a);
+    e_set_voice_pattern(&ev, 1, &b);
+    e_set_voice_length(&ev, 0, 5);
+
+    for (u8 i = 1; i <= 15; i++) {
+        wrapped = e_step_all(&ev);
+        check(e_get_voice_step(&ev, 0) == i % 5 && e_get_voice_step(&ev, 1) == i % 3,
+            "tick %u has voices on %u and %u", i, e_get_voice_step(&ev, 0), e_get_voice_step(&ev, 1));
+    }
+    check(wrapped == 3, "both voices should wrap on tick 15, mask is %u", wrapped);
+}
+
+// with two voices the second one plays the slot after the playing pattern,
+// a queued pattern moves both voices on at the end of the pattern
+static void test_voice_assignment(void) {
+    const u16 period = 100;
+    static engine_pattern_t ep[3];
+    shared_data_t settings;
+
+    for (u8 p = 0; p < 3; p++) {
+        e_init(&ep[p]);
+        for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++) {
+            e_set_gate(&ep[p], i, GATE_ON);
+            e_set_pitch(&ep[p], i, 3 + p * 5);
+        }
+    }
+    default_settings(&settings);
+    settings.voice_count = 2;
+    start(ep, 3, &settings);
+
+    send_clock(period, 3);
+    u16 cv_0 = get_output(STUB_OUTPUT_CV, 0, get_global_time());
+    u16 cv_1 = get_output(STUB_OUTPUT_CV, 1, get_global_time());
+    check(cv_0 != cv_1, "both voices play the same pattern");
+
+    stub_grid_key(3, 1, 1);
+    stub_grid_key(3, 1, 0);
+    send_clock(period, 1);
+    check(get_output(STUB_OUTPUT_CV, 0, get_global_time()) == cv_0 &&
+        get_output(STUB_OUTPUT_CV, 1, get_global_time()) == cv_1, "the queued pattern played early");
+
+    send_clock(period, MAX_PATTERN_LENGTH);
+    u16 cv_2 = get_output(STUB_OUTPUT_CV, 1, get_global_time());
+    check(get_output(STUB_OUTPUT_CV, 0, get_global_time()) == cv_1, "voice 0 isn't on the queued pattern");
+    check(cv_2 != cv_0 && cv_2 != cv_1, "voice 1 isn't on the slot after the queued pattern");
+}
+
+
+// ----------------------------------------------------------------------------
+// undo
+
+static void press(u8 x, u8 y) {
+    stub_grid_key(x, y, 1);
+    stub_grid_key(x, y, 0);
+}
+
+static void undo_key(void) {
+    press(2, 0);
+}
+
+static void redo_key(void) {
+    press(2, 1);
+}
+
+// a full ring drops the oldest edits, undo goes back exactly HISTORY_SIZE
+static void test_history_overflow(void) {
+    history_t h;
+    history_edit_t *e;
+    u8 count = 0;
+
+    history_init(&h);
+    for (u8 i = 0; i < HISTORY_SIZE + 6; i++) history_record(&h, 0, i, HISTORY_PITCH, i, i + 1);
+    check(h.undo_count == HISTORY_SIZE, "%u edits to undo", h.undo_count);
+
+    while ((e = history_undo(&h))) {
+        u8 expected = HISTORY_SIZE + 5 - count;
+        check(e->step == expected, "undo %u returned step %u, not %u", count, e->step, expected);
+        count++;
+    }
+    check(count == HISTORY_SIZE, "%u edits undone", count);
+    check(h.redo_count == HISTORY_SIZE && history_redo(&h)->step == 6, "redo doesn't start at the oldest edit");
+}
+
+// a new edit after an undo drops what could have been redone
+static void test_history_redo_after_edit(void) {
+    history_t h;
+
+    history_init(&h);
+    for (u8 i = 0; i < 3; i++) history_record(&h, 0, i, HISTORY_GATE, 0, 1);
+    history_undo(&h);
+    history_undo(&h);
+    check(history_redo(&h)->step == 1, "redo didn't return the undone edit");
+
+    history_record(&h, 0, 9, HISTORY_GATE, 0, 1);
+    check(!h.redo_count && !history_redo(&h), "redo survived a new edit");
+    check(history_undo(&h)->step == 9 && history_undo(&h)->step == 1, "undo after a new edit out of order");
+
+    history_record(&h, 0, 3, HISTORY_GATE, 1, 1);
+    check(h.redo_count == 2, "an edit that changes nothing dropped redo");
+}
+
+// edits in a group are joined to the one before, the first one isn't
+static void test_history_joined(void) {
+    history_t h;
+
+    history_init(&h);
+    history_record(&h, 0, 0, HISTORY_GATE, 0, 1);
+    history_start_group(&h);
+    for (u8 i = 1; i <= 3; i++) history_record(&h, 0, i, HISTORY_GATE, 0, 1);
+    history_end_group(&h);
+    history_record(&h, 0, 4, HISTORY_GATE, 0, 1);
+
+    check(!(history_undo(&h)->field & HISTORY_JOINED), "the edit after the group is joined to it");
+    check(history_undo(&h)->field & HISTORY_JOINED && history_undo(&h)->field & HISTORY_JOINED, "group edits aren't joined");
+    check(!(history_undo(&h)->field & HISTORY_JOINED), "the first group edit is joined to the one before");
+
+    check(history_redo(&h)->step == 1 && history_redo_joined(&h), "redo doesn't join the group");
+    history_redo(&h);
+    history_redo(&h);
+    check(!history_redo_joined(&h), "redo joins the edit after the group");
+}
+
+// a note played while a step is held sets pitch and gate, undo and redo
+// take both back at once
+static void test_undo_held_step(void) {
+    static engine_pattern_t ep;
+
+    e_init(&ep);
+    start(&ep, 1, NULL);
+    press(0, 0);
+
+    stub_grid_key(TRACKER_X + 1, 2, 1);
+    stub_midi_note(0, LOWEST_NOTE + 7, 100, 1);
+    stub_midi_note(0, LOWEST_NOTE + 7, 0, 0);
+    stub_grid_key(TRACKER_X + 1, 2, 0);
+    check(e_get_pitch(pattern, 2) == 7 && e_get_gate(pattern, 2) == GATE_ON, "the note didn't edit the held step");
+
+    undo_key();
+    check(e_get_pitch(pattern, 2) == 0 && e_get_gate(pattern, 2) == GATE_REST, "undo left part of the note");
+    redo_key();
+    check(e_get_pitch(pattern, 2) == 7 && e_get_gate(pattern, 2) == GATE_ON, "redo left part of the note");
+
+    // undo while the step is held ends the group so far, the next note
+    // starts a new one
+    press(TRACKER_X + 4, 5);
+    stub_grid_key(TRACKER_X + 1, 3, 1);
+    stub_midi_note(0, LOWEST_NOTE + 4, 100, 1);
+    undo_key();
+    stub_midi_note(0, LOWEST_NOTE + 9, 100, 1);
+    stub_grid_key(TRACKER_X + 1, 3, 0);
+    undo_key();
+    check(e_get_gate(pattern, 3) == GATE_REST && e_get_gate(pattern, 5) == GATE_ON, "undo went past the held step");
+}
+
+// undo goes back through a preset switch to the generated pattern before
+// it, a pattern generated before the last one can't be brought back
+static void test_undo_pattern_and_preset(void) {
+    static engine_pattern_t ep;
+    engine_pattern_t before, generated;
+
+    e_init(&ep);
+    start(&ep, 1, NULL);
+    press(0, 0);
+
+    before = *pattern;
+    press(2, GRID_ROWS - 2);
+    generated = *pattern;
+    check(memcmp(&before.p, &generated.p, sizeof(pattern_t)), "nothing was generated");
+
+    press(1, 2);
+    stub_advance_time(AUTOSAVE_WAIT);
+    check(get_preset_index() == 2, "preset 2 wasn't selected");
+    undo_key();
+    stub_advance_time(AUTOSAVE_WAIT);
+    check(get_preset_index() == 0, "undo didn't go back to preset 0");
+    check(!memcmp(&pattern->p, &generated.p, sizeof(pattern_t)), "preset 0 came back without the generated pattern");
+    undo_key();
+    check(!memcmp(&pattern->p, &before.p, sizeof(pattern_t)), "undo didn't bring back the pattern before generating");
+    redo_key();
+    redo_key();
+    stub_advance_time(AUTOSAVE_WAIT);
+    check(get_preset_index() == 2, "redo didn't switch to preset 2 again");
+    undo_key();
+
+    press(2, GRID_ROWS - 2);
+    generated = *pattern;
+    press(2, GRID_ROWS - 2);
+    undo_key();
+    check(!memcmp(&pattern->p, &generated.p, sizeof(pattern_t)), "undo didn't bring back the last generated pattern");
+    undo_key();
+    check(!memcmp(&pattern->p, &generated.p, sizeof(pattern_t)), "undo went past an older generated pattern");
+    check(!history.undo_count, "history kept edits past an older generated pattern");
+}
+
+
+// ----------------------------------------------------------------------------
+// live recording
+
+static void record_key(void) {
+    press(6, GRID_ROWS - 1);
+}
+
+// a clock edge, then a note at the given ms into the step
+static void clock_with_note(u16 period, u16 at, u8 note, u8 on) {
+    stub_clock(1);
+    stub_advance_time(at);
+    stub_midi_note(0, LOWEST_NOTE + note, on ? 100 : 0, on);
+    stub_advance_time((period >> 1) - at);
+    stub_clock(0);
+    stub_advance_time(period - (period >> 1));
+}
+
+// steps follow the reset, a late note goes to the step after the reset and
+// a note held over the reset only ties the steps that played
+static void test_record_reset(void) {
+    const u16 period = 100;
+    static engine_pattern_t ep;
+
+    e_init(&ep);
+    e_set_reset(&ep, 3, 1);
+    start(&ep, 1, NULL);
+    send_clock(period, 8);
+    record_key();
+    record_key();
+
+    clock_with_note(period, 10, 7, 1);
+    send_clock(period, 2);
+    clock_with_note(period, 10, 7, 0);
+    send_clock(period, 2);
+
+    stub_clock(1);
+    stub_advance_time(period >> 1);
+    stub_clock(0);
+    stub_advance_time(20);
+    stub_midi_note(0, LOWEST_NOTE + 4, 100, 1);
+    stub_advance_time(10);
+    stub_midi_note(0, LOWEST_NOTE + 4, 0, 0);
+    stub_advance_time(20);
+    send_clock(period, 2);
+
+    check(e_get_gate(pattern, 1) == GATE_ON && e_get_pitch(pattern, 1) == 7, "the held note didn't start on step 1");
+    check(e_get_gate(pattern, 2) == GATE_TIE && e_get_gate(pattern, 3) == GATE_TIE, "the held note didn't tie to the reset");
+    check(e_get_gate(pattern, 4) == GATE_REST && e_get_gate(pattern, MAX_PATTERN_LENGTH - 1) == GATE_REST,
+        "the held note tied steps past the reset");
+    check(e_get_gate(pattern, 0) == GATE_ON && e_get_pitch(pattern, 0) == 4, "the late note didn't go to the step after the reset");
+}
+
+// a note early for the first step after a reset goes back to the reset
+static void test_record_early(void) {
+    const u16 period = 40;
+    static engine_pattern_t ep;
+    shared_data_t settings;
+
+    default_settings(&settings);
+    settings.record_latency = 3;
+    e_init(&ep);
+    e_set_reset(&ep, 3, 1);
+    start(&ep, 1, &settings);
+    send_clock(period, 8);
+    record_key();
+    record_key();
+
+    send_clock(period, 3);
+    stub_clock(1);
+    stub_midi_note(0, LOWEST_NOTE + 5, 100, 1);
+    stub_midi_note(0, LOWEST_NOTE + 5, 0, 0);
+    stub_advance_time(period >> 1);
+    stub_clock(0);
+    stub_advance_time(period >> 1);
+    send_clock(period, 2);
+
+    check(e_get_gate(pattern, 3) == GATE_ON && e_get_pitch(pattern, 3) == 5, "the early note didn't go to the reset step");
+    check(e_get_gate(pattern, MAX_PATTERN_LENGTH - 1) == GATE_REST, "the early note went to the last step");
+}
+
+// a note tied over the whole pattern is a single edit to undo
+static void test_record_undo(void) {
+    const u16 period = 100;
+    static engine_pattern_t ep;
+
+    e_init(&ep);
+    start(&ep, 1, NULL);
+    send_clock(period, 4);
+    record_key();
+    record_key();
+    u8 undo_count = history.undo_count;
+
+    clock_with_note(period, 10, 9, 1);
+    send_clock(period, MAX_PATTERN_LENGTH - 2);
+    clock_with_note(period, 10, 9, 0);
+    send_clock(period, 2);
+
+    check(e_get_gate(pattern, 5) == GATE_ON, "the held note didn't start on step 5");
+    check(e_get_gate(pattern, 6) == GATE_TIE && e_get_gate(pattern, 3) == GATE_TIE, "the held note didn't tie to step 3");
+    check(e_get_gate(pattern, 4) == GATE_REST, "the held note tied the step it was released on");
+    check(history.undo_count == undo_count + 1, "the take is %u edits", history.undo_count - undo_count);
+
+    undo_key();
+    check(e_get_gate(pattern, 5) == GATE_REST && e_get_gate(pattern, 6) == GATE_REST && e_get_gate(pattern, 3) == GATE_REST,
+        "undo left part of the take");
+    redo_key();
+    check(e_get_gate(pattern, 5) == GATE_ON && e_get_gate(pattern, 3) == GATE_TIE, "redo didn't bring the take back");
+}
+
+
+// ----------------------------------------------------------------------------
+// 303 kernels
+
+// every specialised kernel plays a pattern with ties, accents, slides and
+// ratchets the same as the kernel reading the settings at run time
+static void test_kernels(void) {
+    const u16 period = 100;
+    static engine_pattern_t ep;
+    static output_t expected[MAX_OUTPUTS];
+    shared_data_t settings;
+    step_t s;
+    u32 count;
+
+    e_init(&ep);
+    memset(&s, 0, sizeof(s));
+    for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++) {
+        s.pitch = next_random() % (MAX_PITCH_VALUE + 1);
+        s.gate = next_random() % (GATE_TIE + 1);
+        s.accent = next_random() & 1;
+        s.slide = next_random() & 1;
+        s.ratchet = 1 + next_random() % MAX_RATCHETS;
+        e_set_step(&ep, i, &s);
+    }
+    default_settings(&settings);
+    settings.slide_time = 2;
+
+    for (u8 k = 0; k < 16; k++) {
+        settings.settings_303 = k;
+        start(&ep, 1, &settings);
+        set_output_step_generic(1);
+        send_clock(period, 32);
+        memcpy(expected, outputs, sizeof(outputs));
+        count = output_count;
+        check(count < MAX_OUTPUTS, "settings %u filled the output log", k);
+
+        start(&ep, 1, &settings);
+        set_output_step_generic(0);
+        send_clock(period, 32);
+        check(output_count == count && !memcmp(outputs, expected, count * sizeof(output_t)),
+            "the kernel for settings %u doesn't match", k);
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// lookahead
+
+// a prepared step survives the voice moving onto it, an edit to the step
+// or the step after it, or to the voices, makes it stale
+static void test_lookahead_stale(void) {
+    static engine_pattern_t a, b;
+    engine_voices_t ev;
+    engine_lookahead_t la;
+
+    e_init(&a);
+    e_init(&b);
+    e_init_voices(&ev, 1);
+    e_set_voice_pattern(&ev, 0, &a);
+
+    e_prepare_step(&ev, 0, 1, &la);
+    check(!e_is_prepared(&ev, 0, &la), "a step the voice isn't on is prepared");
+    e_step_all(&ev);
+    check(e_is_prepared(&ev, 0, &la), "moving onto the prepared step made it stale");
+    e_set_pitch(&b, 1, 5);
+    check(e_is_prepared(&ev, 0, &la), "an edit to another pattern made the step stale");
+
+    e_set_pitch(&a, 1, 5);
+    check(!e_is_prepared(&ev, 0, &la), "an edit to the step left it prepared");
+    e_prepare_step(&ev, 0, 1, &la);
+    e_set_slide(&a, 2, 1);
+    check(!e_is_prepared(&ev, 0, &la), "an edit to the next step left it prepared");
+    e_prepare_step(&ev, 0, 1, &la);
+    e_set_voice_length(&ev, 0, 2);
+    check(!e_is_prepared(&ev, 0, &la), "a new voice length left the step prepared");
+    e_prepare_step(&ev, 0, 1, &la);
+    e_set_voice_pattern(&ev, 0, &b);
+    check(!e_is_prepared(&ev, 0, &la), "a new pattern left the step prepared");
+}
+
+// a step edited on the grid after the clock went low plays the edit
+static void test_lookahead_edit(void) {
+    const u16 period = 100;
+    static engine_pattern_t ep;
+
+    e_init(&ep);
+    for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++) {
+        e_set_gate(&ep, i, GATE_ON);
+        e_set_pitch(&ep, i, 3);
+    }
+    start(&ep, 1, NULL);
+    send_clock(period, 2);
+    u16 before = get_output(STUB_OUTPUT_CV, 0, get_global_time());
+
+    stub_grid_key(TRACKER_X + 1, 3, 1);
+    stub_midi_note(0, LOWEST_NOTE + 10, 100, 1);
+    stub_midi_note(0, LOWEST_NOTE + 10, 0, 0);
+    stub_grid_key(TRACKER_X + 1, 3, 0);
+    u16 edited = get_output(STUB_OUTPUT_CV, 0, get_global_time());
+    check(edited != before, "the note didn't play while the step was held");
+
+    send_clock(period, 1);
+    check(get_output(STUB_OUTPUT_CV, 0, get_global_time()) == edited, "step 3 played what was prepared before the edit");
+}
+
+
+// ----------------------------------------------------------------------------
+// presets
+
+// switching presets writes nothing to flash right away, a switch while an
+// earlier preset still waits to be written waits for it, and everything
+// ends up in flash once the timer has run
+static void test_preset_switch(void) {
+    start(NULL, 0, NULL);
+
+    stub_reset_calls();
+    press(1, 2);
+    check(!stub_calls.store_flash, "switching to preset 2 wrote to flash");
+    stub_advance_time(AUTOSAVE_WAIT);
+    check(get_preset_index() == 2, "the timer didn't write the preset index");
+
+    press(TRACKER_X + 4, 1);
+    stub_reset_calls();
+    press(1, 3);
+    press(TRACKER_X + 4, 2);
+    press(1, 4);
+    check(!stub_calls.store_flash, "switching away from edited presets wrote to flash");
+    check(get_preset_index() == 2, "the preset index was written before the timer ran");
+
+    stub_advance_time(AUTOSAVE_WAIT);
+    check(get_preset_index() == 4, "the switch to preset 4 didn't happen");
+    press(1, 2);
+    check(e_get_gate(pattern, 1) == GATE_ON, "preset 2 lost its edit");
+    press(1, 3);
+    check(e_get_gate(pattern, 2) == GATE_ON, "preset 3 lost its edit");
+}
+
+// only presses that change something restart the quiet period
+static void test_autosave_quiet(void) {
+    start(NULL, 0, NULL);
+
+    press(TRACKER_X + 4, 1);
+    stub_advance_time(AUTOSAVE_WAIT / 2);
+    stub_reset_calls();
+    stub_grid_key(TRACKER_X + 4, 6, 0);
+    press(0, 6);
+    press(0, 6);
+    stub_advance_time(AUTOSAVE_WAIT / 2);
+    check(stub_calls.store_flash, "key presses without edits held up the autosave");
+}
+
+
+// ----------------------------------------------------------------------------
+// tempo
+
+// edges every interval ms, the first one at now
+static u64 tempo_edges(tempo_t *t, u64 now, u16 interval, u8 count) {
+    for (u8 i = 0; i < count; i++, now += interval) tempo_edge(t, now);
+    return now - interval;
+}
+
+// the first interval is taken as it is and a steady clock stays on it
+static void test_tempo_steady(void) {
+    tempo_t t;
+
+    tempo_init(&t);
+    tempo_edge(&t, 1000);
+    check(!tempo_get_period(&t), "a single edge gave period %u", tempo_get_period(&t));
+    tempo_edge(&t, 1125);
+    check(tempo_get_period(&t) == 125, "the first interval gave period %u", tempo_get_period(&t));
+
+    u64 last = tempo_edges(&t, 1250, 125, 20);
+    check(tempo_get_period(&t) == 125, "a steady clock drifted to %u", tempo_get_period(&t));
+    check(t.next_edge == last + 125, "the next edge is expected %d ms off", (int)(t.next_edge - last - 125));
+
+    tempo_edge(&t, last);
+    check(tempo_get_period(&t) == 125 && t.last_edge == last, "the same edge twice changed the tempo");
+}
+
+// intervals within the window settle on their average, one far off is
+// ignored and two in a row make the new tempo
+static void test_tempo_jitter(void) {
+    tempo_t t;
+    u64 now = 0;
+    u16 lowest = 0xFFFF, highest = 0;
+
+    tempo_init(&t);
+    for (u8 i = 0; i < 100; i++) {
+        now += 125 - 10 + next_random() % 21;
+        tempo_edge(&t, now);
+        if (i < 20) continue;
+        if (tempo_get_period(&t) < lowest) lowest = tempo_get_period(&t);
+        if (tempo_get_period(&t) > highest) highest = tempo_get_period(&t);
+    }
+    check(lowest >= 120 && highest <= 130, "a jittered clock moved between %u and %u", lowest, highest);
+
+    now = tempo_edges(&t, now + 125, 125, 20);
+    tempo_edge(&t, now + 250);
+    check(tempo_get_period(&t) == 125, "one long interval moved the tempo to %u", tempo_get_period(&t));
+    tempo_edge(&t, now + 375);
+    check(tempo_get_period(&t) == 125, "an interval back on tempo moved it to %u", tempo_get_period(&t));
+    tempo_edge(&t, now + 625);
+    tempo_edge(&t, now + 875);
+    check(tempo_get_period(&t) == 250, "two long intervals in a row gave %u, not 250", tempo_get_period(&t));
+}
+
+// a clock missing for TEMPO_STOP_PERIODS periods is stopped once, and the
+// gap before the next edge isn't taken as a period
+static void test_tempo_stop(void) {
+    tempo_t t;
+
+    tempo_init(&t);
+    u64 last = tempo_edges(&t, 0, 100, 8);
+    check(!tempo_check(&t, last + 100 * TEMPO_STOP_PERIODS), "the clock stopped early");
+    check(tempo_check(&t, last + 100 * TEMPO_STOP_PERIODS + 1), "the clock didn't stop");
+    check(!tempo_get_period(&t) && !t.started, "a stopped clock kept period %u", tempo_get_period(&t));
+    check(!tempo_check(&t, last + 1000), "the clock stopped twice");
+
+    tempo_edge(&t, last + 1000);
+    check(!tempo_get_period(&t), "the gap after a stop gave period %u", tempo_get_period(&t));
+    tempo_edge(&t, last + 1080);
+    check(tempo_get_period(&t) == 80, "the clock started again at %u, not 80", tempo_get_period(&t));
+}
+
+// an interval longer than TEMPO_MAX_PERIOD starts over, and a slow clock
+// is stopped after TEMPO_MAX_PERIOD even if that's less than
+// TEMPO_STOP_PERIODS periods
+static void test_tempo_reset(void) {
+    tempo_t t;
+
+    tempo_init(&t);
+    u64 last = tempo_edges(&t, 0, 200, 4);
+    tempo_edge(&t, last + TEMPO_MAX_PERIOD + 1);
+    check(!tempo_get_period(&t), "a long interval left period %u", tempo_get_period(&t));
+    tempo_edge(&t, last + TEMPO_MAX_PERIOD + 61);
+    check(tempo_get_period(&t) == 60, "the next interval gave %u, not 60", tempo_get_period(&t));
+
+
+    tempo_init(&t);
+    tempo_edges(&t, 0, 2000, 3);
+    check(tempo_check(&t, 4000 + TEMPO_MAX_PERIOD + 1), "a slow clock wasn't stopped after TEMPO_MAX_PERIOD");
+}
+
+
+// ----------------------------------------------------------------------------
+// frame rate
+
+// a key press is only sent to the grid with the next frame
+static void test_render_interval(void) {
+    const u16 intervals[] = { 0, 50, 1000 }, expected[] = { 5, 50, 100 };
+
+    for (u8 i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+        stub_init();
+        init_presets();
+        init_control();
+        set_render_interval(intervals[i]);
+        stub_grid_key(0, 0, 1);
+        stub_reset_calls();
+
+        stub_advance_time(expected[i] - 1);
+        check(!stub_calls.refresh_grid, "interval %u refreshed the grid early", intervals[i]);
+        stub_advance_time(1);
+        check(stub_calls.refresh_grid == 1, "interval %u didn't refresh the grid after %u ms", intervals[i], expected[i]);
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+
+int main(void) {
+    test_running_status();
+    test_realtime_inside_message();
+    test_sysex_skipped();
+    test_system_common_cancels_running_status();
+    test_note_on_with_velocity_0();
+
+    test_round_trip();
+    test_empty_pattern();
+    test_malformed();
+
+    test_wheel_schedule();
+    test_wheel_pool();
+    test_wheel_ratchets();
+
+    test_slide_curve();
+    test_slide_lengths();
+    test_slide_timer();
+
+    test_voice_patterns();
+    test_voice_lengths();
+    test_voice_assignment();
+
+    test_history_overflow();
+    test_history_redo_after_edit();
+    test_history_joined();
+    test_undo_held_step();
+    test_undo_pattern_and_preset();
+
+    test_record_reset();
+    test_record_early();
+    test_record_undo();
+
+    test_kernels();
+
+    test_lookahead_stale();
+    test_lookahead_edit();
+
+    test_preset_switch();
+    test_autosave_quiet();
+
+    test_tempo_steady();
+    test_tempo_jitter();
+    test_tempo_stop();
+    test_tempo_reset();
+
+    test_render_interval();
+
+    printf(failures ? "%u checks failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+// build time configuration
+//
+// GRID_256        build for a 16x16 grid instead of 16x8
+// PATTERN_LENGTH  steps per pattern, 32 or 64. 64 needs a 256 grid so the
+//                 page selectors fit in the tracker menu.
+
+#ifdef GRID_256
+#define GRID_COLUMNS 16
+#define GRID_ROWS 16
+#else
+#define GRID_COLUMNS 16
+#define GRID_ROWS 8
+#endif
+
+#ifndef PATTERN_LENGTH
+#define PATTERN_LENGTH 32
+#endif
+
+// the tracker uses the 8 rightmost columns and shows one step per row. the
+// horizontal view shows the same steps in blocks of 8 columns by 8 rows.
+#define TRACKER_X (GRID_COLUMNS - 8)
+#define TRACKER_LINES GRID_ROWS
+#define TRACKER_BLOCK 8
+
+#if PATTERN_LENGTH != 32 && PATTERN_LENGTH != 64
+#error "PATTERN_LENGTH must be 32 or 64"
+#endif
+
+#if PATTERN_LENGTH / TRACKER_LINES > GRID_ROWS - 2
+#error "too many tracker pages for the grid, use GRID_256 for 64 step patterns"
+#endif
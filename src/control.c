@@ -8,6 +8,16 @@
 #include "control.h"
 #include "interface.h"
 #include "engine.h"
+#include "profile.h"
+#include "wheel.h"
+#include "slide.h"
+#include "evlog.h"
+#include "generator.h"
+#include "scale.h"
+#include "history.h"
+#include "recorder.h"
+#include "midi.h"
+#include "tempo.h"
 
 preset_meta_t meta;
 preset_data_t preset;
@@ -17,18 +27,95 @@ int selected_preset;
 // ----------------------------------------------------------------------------
 // definitions and variables
 
-#define TIMER_RECORDING 0
+// event log for replaying a session on the host, see evlog.h
+#ifdef EVENT_LOG
+#ifndef EVENT_LOG_SIZE
+#define EVENT_LOG_SIZE 4096
+#endif
+#endif
 
-#define TRANSPOSE_OUTPUT 36
+#define RECORDING_BLINK_INTERVAL 200
+#define AUTOSAVE_QUIET_TIME     2000 // ms without edits before anything is saved
+#define AUTOSAVE_INTERVAL          5 // ms between the pieces of a save
+#define AUTOSAVE_MARGIN           20 // ms a flash write needs before the next clock edge
+#define DIAGNOSTICS_WINDOW      1000 // ms the diagnostics page counts over
+#define DIAGNOSTICS_ROWS           8
+#define DEFAULT_RENDER_INTERVAL   20
+#define MIN_RENDER_INTERVAL        5
+#define MAX_RENDER_INTERVAL      100 // the frame timer also notices a stopped clock
+
+#define MAX_GATE_LENGTH 8 // eighths of the clock period, 0 follows the clock
+#define MAX_SWING 7       // odd step delay in sixteenths of the clock period
+#define MAX_SLIDE_TIME 7  // index into slide_times, 0 leaves slides to gate 2
+#define SLIDE_UPDATE_INTERVAL 1
+#define MAX_GENERATOR_LEVEL 7 // generator probabilities in eighths
+#define GENERATOR_SCALE_COUNT 4
+#define MAX_RECORD_LATENCY 3  // recording latency compensation in steps of 10ms
+#define RECORD_LATENCY_UNIT 10
+#define MIDI_DIVIDER_COUNT 4
+
+#define MAX_TRANSPOSE 12 // global transpose in semitones either way
+
+// 303 behaviour, bits of shared.settings_303
+#define SETTING_303_SLIDE         1 // [1] a slide step glides into the next step, not from the previous one
+#define SETTING_HOLD_ACCENT       2 // [2] accent is held on ties and rests
+#define SETTING_GATE_BEFORE_SLIDE 4 // [3] gate stays high before a slide
+#define SETTING_SLIDE_ON_TIES     8 // [4] slide is high on ties and rests
+#define SETTING_303_COUNT 4
+#define SETTING_303_COMBINATIONS (1 << SETTING_303_COUNT)
+#define SETTINGS_303_DEFAULT (SETTING_303_SLIDE | SETTING_GATE_BEFORE_SLIDE | SETTING_SLIDE_ON_TIES)
+
+#define MIDI_CHANNEL 0
+#define MIDI_VELOCITY 96
+#define MIDI_VELOCITY_ACCENT 127
+
+#define SUB_STEP_OUTPUT 0
+#define SUB_STEP_OFF    1
+#define SUB_GATE_ON     2
+#define SUB_GATE_OFF    3
+
+#define TRANSPOSE_OUTPUT LOWEST_NOTE
 #define NO_STEP 255
+#define NO_PATTERN 255
+#define NO_VOICE 255
+#define NO_PRESET 255
+
+#define BOTTOM_ROW (GRID_ROWS - 1)
+#define LED_UNKNOWN 255
+
+#define DIRTY_MENU          1 // columns 0-1
+#define DIRTY_TRACKER_MENU  2 // columns 2 to TRACKER_X - 1
+#define DIRTY_TRACKER       4 // columns TRACKER_X and up
+#define DIRTY_ALL           7
+#define DIRTY_SETTINGS      (DIRTY_TRACKER_MENU | DIRTY_TRACKER)
+#define DIRTY_REGION_COUNT  3
 
-#define PAGE_TRACKER 0
+#define PAGE_TRACKER  0
+#define PAGE_SETTINGS 1
+#define PAGE_SCALE    2
+#define PAGE_DIAGNOSTICS 3
 #define TRACKER_DIR_V 0
 #define TRACKER_DIR_H 1
-#define TRACKER_LINES 8
 
 #define LED_SEQ_ON 15
 #define LED_SEQ_OFF 4
+#define LED_PRESET_ON 15
+#define LED_PRESET_OFF 2
+
+#define LED_PAGE_ON 15
+#define LED_PAGE_OFF 4
+
+#define LED_PATTERN_PLAYING 15
+#define LED_PATTERN_QUEUED   9
+#define LED_PATTERN_EDITED   6
+#define LED_PATTERN_OFF      2
+
+#define LED_SETTING_ON  12
+#define LED_SETTING_OFF  3
+
+#define LED_DIAGNOSTICS_ON  12
+#define LED_DIAGNOSTICS_OFF  2
+
 #define LED_MENU_ON 15
 #define LED_MENU_OFF 4
 
@@ -51,17 +138,142 @@ int selected_preset;
 #define LED_KEYBOARD_CURRENT  9
 #define LED_KEYBOARD_STEP    12
 #define LED_KEYBOARD_NOTE    12
+#define LED_RATCHET_ON       12
+#define LED_RATCHET_OFF       4
+
+#define ARC_RING_STEP      0 // selects the step the other rings edit
+#define ARC_RING_PITCH     1
+#define ARC_RING_TRANSPOSE 2
+#define ARC_RING_COUNT     4
+#define ARC_DIRTY_ALL     15
+#define ARC_LEDS          64
+#define ARC_SENSITIVITY    4 // encoder steps per value change
+#define ARC_TURN_GAP     500 // ms the pitch ring rests before a turn is over
+
+#define LED_ARC_TICK      3
+#define LED_ARC_PLAYING   6
+#define LED_ARC_SELECTED 15
+#define LED_ARC_REST      4
+#define LED_ARC_VALUE    10
+#define LED_ARC_CENTER    6
 
 #define RECORDING_OFF   0
 #define RECORDING_ARMED 1
 #define RECORDING_ON    2
 
-// pattern
-engine_pattern_t pattern;
+// patterns
+// slots point into pattern_storage. step() only reads the patterns the
+// voices play, edits to those go to a copy in the voice's spare which is
+// swapped in on the next step. edit_pending has a bit for each voice with
+// a copy waiting. a queued pattern replaces playing when the cycle ends.
+engine_pattern_t pattern_storage[PATTERN_COUNT + MAX_VOICES];
+engine_pattern_t *patterns[PATTERN_COUNT];
+engine_pattern_t *spares[MAX_VOICES], *playing;
+engine_pattern_t *pattern; // the pattern shown and edited on the grid
+u8 playing_index, edited_index, queued_index, edit_pending;
+
+// undo/redo for step edits made on the grid, edits made while a step is
+// held are undone together. switching presets is recorded too. generating
+// a pattern or recording a take keeps the pattern it replaced in replaced,
+// undo and redo swap them. only the last one can be undone, replaced_id
+// tells which one that is.
+history_t history;
+engine_pattern_t replaced;
+u8 replaced_id;
+
+// voices
+// voice 0 plays the playing pattern, each further voice plays the slot
+// after the previous one. voice n uses cv n and gate n, voice 0 only sends
+// accent and slide on gates 1 and 2 while they're not used by other voices.
+engine_voices_t voices;
 
 // sequencer
 u8 seq_on;
 
+// time from a clock event to its outputs being written
+latency_t clock_latency, clock_off_latency;
+u32 clock_event_time;
+
+// diagnostics
+// counted all the time, the diagnostics page shows the last full window.
+// events and renders are counted with their worst time in cycles, clock
+// edges with the worst time step() took. frame_events is how many events
+// came in since the last render timer, the closest to the event queue
+// depth control.c gets to see.
+window_t diag_clock, diag_event, diag_render, diag_coalesced, diag_frame_events;
+u32 diag_window_start, frame_events;
+
+#ifdef EVENT_LOG
+u8 event_log_buffer[EVENT_LOG_SIZE];
+evlog_t event_log;
+#endif
+
+// sub-step timing
+// ratchets, gate length and swing are scheduled on a 1ms timing wheel
+// relative to the clock period. the tempo tracker smooths the period over
+// clock edges, clock_period is its estimate in ms and 0 while there is
+// none: before the second edge and once the clock has stopped.
+wheel_t wheel;
+tempo_t tempo;
+u16 clock_period, step_delay;
+
+// internal slide
+// a slide step glides cv into the next gated step and holds its gate like
+// a tie. the glide needs a slide time, the gate doesn't. cv_value is what
+// cv 0 was last set to, slides start from there.
+slide_t slide;
+u16 cv_value;
+u8 slide_next, gate_held, gate_timed;
+
+static const u16 slide_times[MAX_SLIDE_TIME + 1] = { 0, 20, 40, 60, 80, 120, 160, 240 };
+
+// scale page key layout, black keys sit above the white key to their right
+static const s8 root_keys[2][7] = {
+    { -1, 1, 3, -1, 6, 8, 10 },
+    {  0, 2, 4,  5, 7, 9, 11 }
+};
+
+// pitch and transpose to dac for the selected scale, root and tuning
+pitch_table_t pitch_table;
+
+// lookahead
+// step_off reads the next step of each voice and converts its pitch, the
+// clock edge then only checks nothing changed since and copies it out.
+// edits are caught by the engine, a new pitch table clears the pattern.
+engine_lookahead_t lookahead[MAX_VOICES];
+u16 lookahead_dac[MAX_VOICES];
+
+// midi
+// while midi clock runs every divider-th tick is a clock edge and the main
+// clock input is ignored. gate 0 is mirrored as notes, see set_main_gate.
+midi_ring_t midi_in, midi_out;
+midi_parser_t midi_parser;
+u8 midi_clock_running, midi_clock_tick;
+u8 midi_next_note, midi_next_velocity;
+s8 midi_note;
+
+// midi clock ticks per step: 32nd, 16th, 8th and quarter notes
+static const u8 midi_dividers[MIDI_DIVIDER_COUNT] = { 3, 6, 12, 24 };
+
+// generator scales over one octave: minor, phrygian, minor pentatonic, chromatic
+static const u16 generator_scales[GENERATOR_SCALE_COUNT] = { 0x5AD, 0x5AB, 0x4A9, 0xFFF };
+
+// autosave
+// edits mark their pattern in autosave_dirty and restart the quiet timer.
+// once it fires each run does one piece of the save, re-encoding a dirty
+// pattern into the preset image or writing one block to flash, and only
+// when the write can't run into a clock edge. encoded_length is where each
+// pattern sits in the image, saved_shared is what flash holds. a preset
+// that is switched away from with unsaved edits waits in left_preset until
+// the timer gets to write it, along with the new preset index. a switch
+// that would need a second one to wait is held in switch_index until then.
+u8 autosave_dirty, autosave_store;
+u8 encoded_length[PATTERN_COUNT];
+shared_data_t saved_shared;
+preset_meta_t left_meta;
+preset_data_t left_preset;
+u8 left_index, left_store, index_store, switch_index;
+
 // ui
 u8 page, tracker_dir, follow_tracker_page;
 u8 tracker_page_count, tracker_selector_y1, tracker_selector_y2;
@@ -70,13 +282,52 @@ u8 tracker_page, tracker_start_step;
 u8 keyboard_on, recording_mode, edited_step;
 s8 keyboard_note, recording_led;
 
-// settings TODO
-/*
-u8 setting_303_slide = 1;                       // [1]
-u8 setting_hold_accent_on_ties_and_rests = 1;   // [2]
-u8 setting_gate_stays_high_before_slide = 1;    // [3]
-u8 setting_slide_is_high_on_ties_and_rests = 1; // [4]
-*/
+// live recording
+// keyboard presses are captured with their time and written into the
+// playing pattern by step() after its outputs, quantized against the clock
+// edge before. a held note ties into the following steps on release. a
+// take is kept as one generated pattern would be, record_index is the
+// pattern it was kept for.
+recorder_t recorder;
+u32 record_clock_time;
+u8 record_clock_step, record_prev_step, record_start, record_accent, record_index;
+s8 record_pitch;
+
+// arc
+// encoder events only add up in arc_delta, the render timer applies them
+// once per frame. rings are drawn the same way as the grid, only rings
+// marked in arc_dirty are redrawn and only changed LEDs are sent. a turn
+// of the pitch ring is one edit, arc_turn_head is where history was after
+// it and arc_turn_time is when it last moved.
+s16 arc_delta[ARC_RING_COUNT];
+u8 arc_step, arc_delta_pending, arc_dirty, arc_refresh_pending;
+u8 arc_turn_head;
+u64 arc_turn_time;
+u8 arc_frame[ARC_RING_COUNT][ARC_LEDS];
+u8 arc_sent[ARC_RING_COUNT][ARC_LEDS];
+
+// grid framebuffer
+// render functions draw into grid_frame, render_grid then only sends LEDs
+// that differ from grid_sent. only regions marked in grid_dirty are redrawn.
+u8 grid_frame[GRID_ROWS][GRID_COLUMNS];
+u8 grid_sent[GRID_ROWS][GRID_COLUMNS];
+u8 grid_dirty, grid_refresh_pending;
+
+// refresh requests are coalesced into at most one grid refresh per interval
+u16 render_interval;
+
+static const u8 dirty_region_x1[DIRTY_REGION_COUNT] = { 0, 2, TRACKER_X };
+static const u8 dirty_region_x2[DIRTY_REGION_COUNT] = { 2, TRACKER_X, GRID_COLUMNS };
+
+// 303 behaviour
+// output_step is one of SETTING_303_COMBINATIONS kernels, each built with
+// its settings as constants so the clock path has no branches on them.
+// select_output_step picks the kernel whenever shared.settings_303 changes.
+static void (*output_step)(void);
+
+#ifdef OUTPUT_STEP_GENERIC
+u8 output_step_generic;
+#endif
 
 static void grid_press(u8 x, u8 y, u8 pressed);
 static void grid_press_menu(u8 x, u8 y, u8 pressed);
@@ -84,19 +335,120 @@ static void grid_press_tracker(u8 x, u8 y, u8 pressed);
 static void grid_press_tracker_menu(u8 x, u8 y, u8 pressed);
 static void grid_press_tracker_tracker(u8 x, u8 y, u8 pressed);
 
+static void grid_press_settings(u8 x, u8 y, u8 pressed);
+static void grid_press_scale(u8 x, u8 y, u8 pressed);
+
 static void render_menu(void);
-static void render_tracker(void);
+static void render_settings(void);
+static void render_scale(void);
+static void render_diagnostics(void);
+static void grid_press_diagnostics(u8 x, u8 y, u8 pressed);
+static void reset_diagnostics(void);
+static void roll_diagnostics(void);
+static void render_tracker(u8 dirty);
 static void render_tracker_menu(void);
 static void render_tracker_tracker(void);
 
+static void clock_edge(u8 on);
+static void midi_clock(void);
+static void receive_note(u8 note, u8 on);
+#ifdef EVENT_LOG
+static void log_midi(u8 from, u8 to);
+#endif
 static void step(void);
 static void step_off(void);
+static void select_output_step(void);
+static void output_step_off(void);
+static void prepare_next_step(void);
+static void prepare_step(u8 voice, u8 step);
+static engine_lookahead_t *get_step(u8 voice);
+static void measure_clock(void);
+static void schedule(u16 ms, u8 type);
+static void assign_voices(void);
+static void set_voice_count(u8 count);
+static void generate(u8 new_seed);
+static void update_pitch_table(void);
+static u16 pitch_to_dac(s8 pitch, u8 transpose);
+static void output_pitch(u16 value);
+static void set_pitch(u16 value);
+static void set_main_gate(u8 on);
+static void set_midi_note(s8 pitch, u8 transpose, u8 accent);
+static void play_note(u8 note, u8 pressed);
+static void sub_step(u8 type, u8 data);
+
+static void init_patterns(void);
+static void select_pattern(u8 index);
+static u8 get_voice(u8 index);
+static engine_pattern_t *pending_pattern(u8 index);
+static void update_edited_pattern(void);
+static void edit_pattern(void);
+static engine_pattern_t *editable_pattern(u8 index);
+static void commit_edits(void);
+
+static void edit_step(u8 step, u8 field, s8 value);
+static void edit_pattern_step(u8 index, u8 step, u8 field, s8 value);
+static s8 get_field(engine_pattern_t *ep, u8 step, u8 field);
+static void set_field(engine_pattern_t *ep, u8 step, u8 field, s8 value);
+static void apply_edit(history_edit_t *e, s8 value);
+static void swap_replaced(u8 index);
+static void undo(void);
+static void redo(void);
+
+static void select_preset(u8 index);
+static void load_preset(u8 index);
+static void save_preset(void);
+static void encode_pattern(u8 index);
+static void mark_pattern_dirty(u8 index);
+static void autosave_later(void);
+static void autosave(void);
+static u8 autosave_step(void);
+static u16 autosave_wait(void);
+
+static void set_recording_mode(u8 mode);
+static u8 record_notes(void);
+static u8 record_step(s8 offset);
+static void record_ties(u8 end);
+static void record_edit(u8 step, u8 field, s8 value);
+
+static void set_led(u8 x, u8 y, u8 level);
+static void refresh(u8 regions);
+static void invalidate_grid(void);
+
+static void apply_arc_deltas(void);
+static void render_arc_step(void);
+static void render_arc_pitch(void);
+static void render_arc_transpose(void);
+static void refresh_arc_rings(u8 rings);
+static void invalidate_arc(void);
 
 
 // ----------------------------------------------------------------------------
 // functions for multipass
 
 void init_presets(void) {
+    u16 length = 0;
+    
+    init_patterns();
+    for (u8 i = 0; i < PATTERN_COUNT; i++) length += e_encode_pattern(patterns[i], preset.patterns + length);
+    
+    shared.gate_length = 0;
+    shared.swing = 0;
+    shared.slide_time = 0;
+    shared.voice_count = 1;
+    shared.generator_density = 5;
+    shared.generator_accent = 2;
+    shared.generator_slide = 2;
+    shared.generator_octave = 1;
+    shared.generator_scale = 0;
+    shared.generator_seed = 1;
+    shared.scale = 0;
+    shared.root = 0;
+    shared.tuning = 0;
+    shared.record_latency = 0;
+    shared.midi_divider = 1;
+    shared.transpose = 0;
+    shared.settings_303 = SETTINGS_303_DEFAULT;
+    
     for (u8 i = 0; i < get_preset_count(); i++) {
         store_preset_to_flash(i, &meta, &preset);
     }
@@ -110,16 +462,43 @@ void init_control(void) {
     selected_preset = get_preset_index();
     load_preset_from_flash(selected_preset, &preset);
     load_preset_meta_from_flash(selected_preset, &meta);
+    
+    if (shared.gate_length > MAX_GATE_LENGTH) shared.gate_length = 0;
+    if (shared.swing > MAX_SWING) shared.swing = 0;
+    if (shared.slide_time > MAX_SLIDE_TIME) shared.slide_time = 0;
+    if (!shared.voice_count || shared.voice_count > MAX_VOICES) shared.voice_count = 1;
+    if (shared.generator_density > MAX_GENERATOR_LEVEL) shared.generator_density = 5;
+    if (shared.generator_accent > MAX_GENERATOR_LEVEL) shared.generator_accent = 2;
+    if (shared.generator_slide > MAX_GENERATOR_LEVEL) shared.generator_slide = 2;
+    if (shared.generator_octave > MAX_GENERATOR_LEVEL) shared.generator_octave = 1;
+    if (shared.generator_scale >= GENERATOR_SCALE_COUNT) shared.generator_scale = 0;
+    if (shared.scale >= SCALE_COUNT) shared.scale = 0;
+    if (shared.root >= ROOT_COUNT) shared.root = 0;
+    if (shared.tuning >= TUNING_COUNT) shared.tuning = 0;
+    if (shared.record_latency > MAX_RECORD_LATENCY) shared.record_latency = 0;
+    if (shared.midi_divider >= MIDI_DIVIDER_COUNT) shared.midi_divider = 1;
+    if (shared.transpose > MAX_TRANSPOSE || shared.transpose < -MAX_TRANSPOSE) shared.transpose = 0;
+    if (shared.settings_303 >= SETTING_303_COMBINATIONS) shared.settings_303 = SETTINGS_303_DEFAULT;
+    update_pitch_table();
+    select_output_step();
+    memcpy(&saved_shared, &shared, sizeof(shared_data_t));
+    
+    autosave_dirty = autosave_store = left_store = index_store = 0;
+    switch_index = NO_PRESET;
+    stop_timed_event(TIMER_AUTOSAVE);
 
-    e_init(&pattern);
     seq_on = 1;
+    init_patterns();
+    load_preset(selected_preset);
+    e_init_voices(&voices, shared.voice_count);
+    assign_voices();
     
     page = PAGE_TRACKER;
     tracker_dir = TRACKER_DIR_V;
     follow_tracker_page = 0;
     
     tracker_page_count = MAX_PATTERN_LENGTH / TRACKER_LINES;
-    tracker_selector_y1 = (TRACKER_LINES - tracker_page_count) >> 1;
+    tracker_selector_y1 = (GRID_ROWS - tracker_page_count) >> 1;
     tracker_selector_y2 = tracker_selector_y1 + tracker_page_count - 1;
     
     tracker_page = 0;
@@ -127,19 +506,61 @@ void init_control(void) {
 
     keyboard_on = 0;
     recording_mode = RECORDING_OFF;
+    stop_timed_event(TIMER_RECORDING);
     edited_step = NO_STEP;
     
     keyboard_note = -1;
     recording_led = 0;
     
-    refresh_grid();
-    add_timed_event(TIMER_RECORDING, 200, 1);
+    recorder_init(&recorder);
+    record_clock_time = record_clock_step = record_accent = 0;
+    record_start = record_prev_step = NO_STEP;
+    record_index = NO_PATTERN;
+    
+    latency_reset(&clock_latency);
+    latency_reset(&clock_off_latency);
+    reset_diagnostics();
+    
+#ifdef EVENT_LOG
+    evlog_init(&event_log, event_log_buffer, EVENT_LOG_SIZE);
+#endif
+    
+    wheel_init(&wheel);
+    tempo_init(&tempo);
+    clock_period = step_delay = 0;
+    
+    slide_stop(&slide);
+    stop_timed_event(TIMER_SLIDE);
+    cv_value = slide_next = gate_held = gate_timed = 0;
+    
+    midi_ring_init(&midi_in);
+    midi_ring_init(&midi_out);
+    midi_parser_init(&midi_parser);
+    midi_clock_running = midi_clock_tick = 0;
+    midi_next_note = midi_next_velocity = 0;
+    midi_note = -1;
+    
+    for (u8 r = 0; r < ARC_RING_COUNT; r++) arc_delta[r] = 0;
+    arc_step = arc_delta_pending = 0;
+    invalidate_arc();
+    refresh_arc_rings(ARC_DIRTY_ALL);
+    
+    invalidate_grid();
+    refresh(DIRTY_ALL);
+    render_interval = 0;
+    set_render_interval(DEFAULT_RENDER_INTERVAL);
 }
 
 void process_event(u8 event, u8 *data, u8 length) {
+    u32 event_start = get_cycles();
+    
+#ifdef EVENT_LOG
+    if (event != TIMED_EVENT) evlog_record(&event_log, get_global_time(), event, data, length);
+#endif
+    
     switch (event) {
         case MAIN_CLOCK_RECEIVED:
-            if (data[1]) step(); else step_off();
+            if (!midi_clock_running) clock_edge(data[1]);
             break;
         
         case MAIN_CLOCK_SWITCHED:
@@ -148,14 +569,33 @@ void process_event(u8 event, u8 *data, u8 length) {
         case GATE_RECEIVED:
             break;
         
+        case GRID_CONNECTED:
+            invalidate_grid();
+            refresh(DIRTY_ALL);
+            break;
+    
         case GRID_KEY_PRESSED:
             grid_press(data[0], data[1], data[2]);
             break;
     
         case GRID_KEY_HELD:
             break;
+        
+        case ARC_CONNECTED:
+            invalidate_arc();
+            refresh_arc_rings(ARC_DIRTY_ALL);
+            break;
+        
+        case ARC_ENCODER_COARSE:
+            if (data[0] < ARC_RING_COUNT) {
+                arc_delta[data[0]] += data[1] ? 1 : -1;
+                arc_delta_pending = 1;
+                autosave_later();
+            }
+            break;
             
         case FRONT_BUTTON_PRESSED:
+            if (data[0]) save_preset();
             break;
     
         case FRONT_BUTTON_HELD:
@@ -163,63 +603,426 @@ void process_event(u8 event, u8 *data, u8 length) {
     
         case BUTTON_PRESSED:
             break;
+        
+        // notes from a main.c that doesn't pass midi bytes on, the data is
+        // channel, note, velocity and 1 for note on
+        case MIDI_NOTE:
+            if (length >= 4) receive_note(data[1], data[3] && data[2]);
+            break;
     
         case TIMED_EVENT:
-            if (data[0] == TIMER_RECORDING) {
+            if (data[0] == TIMER_WHEEL) {
+                wheel_advance(&wheel, sub_step);
+                if (!wheel_count(&wheel)) stop_timed_event(TIMER_WHEEL);
+            } else if (data[0] == TIMER_SLIDE) {
+                cv_value = slide_update(&slide);
+                set_cv(0, cv_value);
+                if (!slide.active) stop_timed_event(TIMER_SLIDE);
+            } else if (data[0] == TIMER_RENDER) {
+                window_peak(&diag_frame_events, frame_events);
+                frame_events = 0;
+                if (get_global_time() - diag_window_start >= DIAGNOSTICS_WINDOW) roll_diagnostics();
+                if (tempo_check(&tempo, get_global_time())) clock_period = 0;
+                if (arc_delta_pending) apply_arc_deltas();
+                if (grid_refresh_pending) {
+                    grid_refresh_pending = 0;
+                    refresh_grid();
+                }
+                if (arc_refresh_pending) {
+                    arc_refresh_pending = 0;
+                    if (is_arc_connected()) refresh_arc();
+                }
+            } else if (data[0] == TIMER_RECORDING) {
                 recording_led = !recording_led;
-                refresh_grid();
+                refresh(DIRTY_TRACKER_MENU);
+            } else if (data[0] == TIMER_AUTOSAVE) {
+                autosave();
             }
             break;
         
         default:
             break;
     }
+    
+    window_count(&diag_event);
+    window_peak(&diag_event, get_cycles() - event_start);
+    frame_events++;
 }
 
-void render_arc() {}
+void process_midi() {
+    midi_message_t m;
+#ifdef EVENT_LOG
+    u8 tail = midi_in.tail;
+#endif
+    
+    while (midi_parse(&midi_parser, &midi_in, &m)) {
+        switch (m.status < MIDI_SYSEX ? m.status & 0xF0 : m.status) {
+            case MIDI_CLOCK:
+                midi_clock();
+                break;
+            
+            // the first tick after start plays the first step
+            case MIDI_START:
+                for (u8 v = 0; v < e_get_voice_count(&voices); v++)
+                    e_set_voice_step(&voices, v, MAX_PATTERN_LENGTH - 1);
+                midi_clock_running = 1;
+                midi_clock_tick = 0;
+                break;
+            
+            case MIDI_CONTINUE:
+                midi_clock_running = 1;
+                midi_clock_tick = 0;
+                break;
+            
+            // a step that is still open ends now
+            case MIDI_STOP:
+                if (midi_clock_running && midi_clock_tick && midi_clock_tick <= midi_dividers[shared.midi_divider] >> 1)
+                    clock_edge(0);
+                midi_clock_running = 0;
+                break;
+            
+            case MIDI_NOTE_ON:
+            case MIDI_NOTE_OFF:
+                receive_note(m.data1, (m.status & 0xF0) == MIDI_NOTE_ON && m.data2);
+                break;
+            
+            default:
+                break;
+        }
+    }
+    
+#ifdef EVENT_LOG
+    log_midi(tail, midi_in.tail);
+#endif
+}
+
+#ifdef EVENT_LOG
+// logs what the parser read from midi_in, replaying the bytes at once
+// parses the same messages. they stay in the ring until the port wraps
+// around to them.
+void log_midi(u8 from, u8 to) {
+    u8 length = to - from;
+    u16 first = MIDI_RING_SIZE - from;
+    
+    if (!length) return;
+    if (first >= length) {
+        evlog_record(&event_log, get_global_time(), EVLOG_MIDI, midi_in.data + from, length);
+    } else {
+        evlog_record(&event_log, get_global_time(), EVLOG_MIDI, midi_in.data + from, first);
+        evlog_record(&event_log, get_global_time(), EVLOG_MIDI, midi_in.data, length - first);
+    }
+}
+#endif
+
+latency_t *get_clock_latency() {
+    return &clock_latency;
+}
+
+latency_t *get_clock_off_latency() {
+    return &clock_off_latency;
+}
+
+#ifdef EVENT_LOG
+evlog_t *get_event_log() {
+    return &event_log;
+}
+#endif
+
+void render_arc() {
+    u8 dirty = arc_dirty;
+    arc_dirty = 0;
+    
+    for (u8 r = 0; r < ARC_RING_COUNT; r++)
+        if (dirty & (1 << r)) memset(arc_frame[r], 0, ARC_LEDS);
+    
+    if (dirty & (1 << ARC_RING_STEP)) render_arc_step();
+    if (dirty & (1 << ARC_RING_PITCH)) render_arc_pitch();
+    if (dirty & (1 << ARC_RING_TRANSPOSE)) render_arc_transpose();
+    
+    for (u8 r = 0; r < ARC_RING_COUNT; r++)
+        if (dirty & (1 << r))
+            for (u8 led = 0; led < ARC_LEDS; led++)
+                if (arc_frame[r][led] != arc_sent[r][led]) {
+                    arc_sent[r][led] = arc_frame[r][led];
+                    set_arc_led(r, led, arc_frame[r][led]);
+                }
+}
 
 void render_grid() {
-    clear_all_grid_leds();
-    render_menu();
+    u32 render_start = get_cycles();
+    u8 dirty = grid_dirty;
+    grid_dirty = 0;
+    
+    for (u8 r = 0; r < DIRTY_REGION_COUNT; r++)
+        if (dirty & (1 << r))
+            for (u8 y = 0; y < GRID_ROWS; y++)
+                for (u8 x = dirty_region_x1[r]; x < dirty_region_x2[r]; x++) grid_frame[y][x] = 0;
     
-    if (page == PAGE_TRACKER) render_tracker();
+    if (dirty & DIRTY_MENU) render_menu();
+    if (page == PAGE_TRACKER) render_tracker(dirty);
+    else if (page == PAGE_SETTINGS && (dirty & DIRTY_SETTINGS)) render_settings();
+    else if (page == PAGE_SCALE && (dirty & DIRTY_SETTINGS)) render_scale();
+    else if (page == PAGE_DIAGNOSTICS && (dirty & DIRTY_SETTINGS)) render_diagnostics();
+    
+    for (u8 r = 0; r < DIRTY_REGION_COUNT; r++)
+        if (dirty & (1 << r))
+            for (u8 y = 0; y < GRID_ROWS; y++)
+                for (u8 x = dirty_region_x1[r]; x < dirty_region_x2[r]; x++)
+                    if (grid_frame[y][x] != grid_sent[y][x]) {
+                        grid_sent[y][x] = grid_frame[y][x];
+                        set_grid_led(x, y, grid_frame[y][x]);
+                    }
+    
+    window_count(&diag_render);
+    window_peak(&diag_render, get_cycles() - render_start);
 }
 
+// pattern edits and preset switches restart the autosave quiet period
+// themselves, any other press only does if it changed a setting
 void grid_press(u8 x, u8 y, u8 pressed) {
-    if (x < 2) {
-        grid_press_menu(x, y, pressed);
-        return;
-    }
+    shared_data_t before;
+    memcpy(&before, &shared, sizeof(shared_data_t));
     
-    if (page == PAGE_TRACKER) grid_press_tracker(x, y, pressed);
+    if (x < 2) grid_press_menu(x, y, pressed);
+    else if (page == PAGE_TRACKER) grid_press_tracker(x, y, pressed);
+    else if (page == PAGE_SETTINGS) grid_press_settings(x, y, pressed);
+    else if (page == PAGE_SCALE) grid_press_scale(x, y, pressed);
+    else if (page == PAGE_DIAGNOSTICS) grid_press_diagnostics(x, y, pressed);
+    
+    if (memcmp(&before, &shared, sizeof(shared_data_t))) autosave_later();
 }
 
 // ----------------------------------------------------------------------------
 // main menu
 
 void render_menu() {
-    set_grid_led(0, 0, seq_on ? LED_SEQ_ON : LED_SEQ_OFF);
+    set_led(0, 0, seq_on ? LED_SEQ_ON : LED_SEQ_OFF);
+    
+    set_led(0, 5, page == PAGE_SCALE ? LED_PAGE_ON : LED_PAGE_OFF);
+    set_led(0, 6, page == PAGE_TRACKER || page == PAGE_DIAGNOSTICS ? LED_PAGE_ON : LED_PAGE_OFF);
+    set_led(0, 7, page == PAGE_SETTINGS ? LED_PAGE_ON : LED_PAGE_OFF);
+    
+    for (u8 y = 0; y < GRID_ROWS && y < get_preset_count(); y++)
+        set_led(1, y, y == selected_preset ? LED_PRESET_ON : LED_PRESET_OFF);
 }
 
 void grid_press_menu(u8 x, u8 y, u8 pressed) {
-    if (x == 0 && y == 0 && pressed) {
+    if (!pressed) return;
+    
+    if (x == 0 && y == 0) {
         seq_on = !seq_on;
-        if (!seq_on) set_gate(0, 0);
-        recording_mode = RECORDING_OFF;
-        refresh_grid();
+        if (!seq_on) set_main_gate(0);
+        set_recording_mode(RECORDING_OFF);
+        if (!seq_on) {
+            commit_edits();
+            queued_index = NO_PATTERN;
+            wheel_clear(&wheel);
+            stop_timed_event(TIMER_WHEEL);
+        }
+        refresh(DIRTY_MENU | DIRTY_TRACKER_MENU | DIRTY_TRACKER);
+    }
+    
+    // the tracker key opens the diagnostics page when already on the tracker
+    else if (x == 0 && y >= 5) {
+        if (y == 6) page = page == PAGE_TRACKER ? PAGE_DIAGNOSTICS : PAGE_TRACKER;
+        else page = y == 5 ? PAGE_SCALE : PAGE_SETTINGS;
+        refresh(DIRTY_ALL);
+    }
+    
+    else if (x == 1 && y < get_preset_count()) {
+        history_record(&history, 0, 0, HISTORY_PRESET, selected_preset, y);
+        select_preset(y);
     }
 }
 
+// ----------------------------------------------------------------------------
+// settings
+
+void render_settings() {
+    // midi clock divider
+    for (u8 x = 0; x < MIDI_DIVIDER_COUNT; x++)
+        set_led(2 + x, 0, x == shared.midi_divider ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    // 303 behaviour toggles
+    for (u8 x = 0; x < SETTING_303_COUNT; x++)
+        set_led(2 + x, 1, shared.settings_303 & (1 << x) ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    // gate length, the first column follows the clock
+    set_led(7, 0, shared.gate_length ? LED_SETTING_OFF : LED_SETTING_ON);
+    for (u8 x = 0; x < MAX_GATE_LENGTH; x++)
+        set_led(8 + x, 0, x < shared.gate_length ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    // swing
+    for (u8 x = 0; x <= MAX_SWING; x++)
+        set_led(8 + x, 1, x <= shared.swing ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    // slide time, the first column leaves slides to gate 2
+    for (u8 x = 0; x <= MAX_SLIDE_TIME; x++)
+        set_led(8 + x, 2, x <= shared.slide_time ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    // voice count
+    for (u8 x = 0; x < MAX_VOICES; x++)
+        set_led(8 + x, 3, x < shared.voice_count ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    // recording latency compensation
+    for (u8 x = 0; x <= MAX_RECORD_LATENCY; x++)
+        set_led(12 + x, 3, x <= shared.record_latency ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    // generator density, accent, slide and octave probabilities and scale
+    for (u8 x = 0; x <= MAX_GENERATOR_LEVEL; x++) {
+        set_led(8 + x, 4, x <= shared.generator_density ? LED_SETTING_ON : LED_SETTING_OFF);
+        set_led(8 + x, 5, x <= shared.generator_accent ? LED_SETTING_ON : LED_SETTING_OFF);
+        set_led(8 + x, 6, x <= shared.generator_slide ? LED_SETTING_ON : LED_SETTING_OFF);
+        set_led(8 + x, 7, x <= shared.generator_octave ? LED_SETTING_ON : LED_SETTING_OFF);
+    }
+    for (u8 y = 0; y < GENERATOR_SCALE_COUNT; y++)
+        set_led(5, 4 + y, y == shared.generator_scale ? LED_SETTING_ON : LED_SETTING_OFF);
+}
+
+void grid_press_settings(u8 x, u8 y, u8 pressed) {
+    if (!pressed) return;
+    
+    if (y == 0 && x >= 7) {
+        shared.gate_length = x - 7;
+        refresh(DIRTY_SETTINGS);
+    }
+    
+    else if (y == 0 && x >= 2 && x < 2 + MIDI_DIVIDER_COUNT) {
+        shared.midi_divider = x - 2;
+        refresh(DIRTY_SETTINGS);
+    }
+    
+    else if (y == 1 && x >= 2 && x < 2 + SETTING_303_COUNT) {
+        shared.settings_303 ^= 1 << (x - 2);
+        select_output_step();
+        refresh(DIRTY_SETTINGS);
+    }
+    
+    else if (y == 1 && x >= 8) {
+        shared.swing = x - 8;
+        refresh(DIRTY_SETTINGS);
+    }
+    
+    else if (y == 2 && x >= 8) {
+        shared.slide_time = x - 8;
+        refresh(DIRTY_SETTINGS);
+    }
+    
+    else if (y == 3 && x >= 8 && x < 8 + MAX_VOICES) {
+        set_voice_count(x - 7);
+        refresh(DIRTY_SETTINGS);
+    }
+    
+    else if (y == 3 && x >= 12) {
+        shared.record_latency = x - 12;
+        refresh(DIRTY_SETTINGS);
+    }
+    
+    else if (y >= 4 && x >= 8) {
+        u8 *level = y == 4 ? &shared.generator_density : y == 5 ? &shared.generator_accent :
+            y == 6 ? &shared.generator_slide : &shared.generator_octave;
+        *level = x - 8;
+        refresh(DIRTY_SETTINGS);
+    }
+    
+    else if (x == 5 && y >= 4 && y < 4 + GENERATOR_SCALE_COUNT) {
+        shared.generator_scale = y - 4;
+        refresh(DIRTY_SETTINGS);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// scale
+
+void render_scale() {
+    for (u8 x = 0; x < SCALE_COUNT; x++)
+        set_led(8 + x, 0, x == shared.scale ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    for (u8 y = 0; y < 2; y++)
+        for (u8 x = 0; x < 7; x++)
+            if (root_keys[y][x] >= 0)
+                set_led(8 + x, 1 + y, root_keys[y][x] == shared.root ? LED_SETTING_ON : LED_SETTING_OFF);
+    
+    for (u8 x = 0; x < TUNING_COUNT; x++)
+        set_led(8 + x, 4, x == shared.tuning ? LED_SETTING_ON : LED_SETTING_OFF);
+}
+
+void grid_press_scale(u8 x, u8 y, u8 pressed) {
+    if (!pressed || x < 8) return;
+    
+    if (y == 0 && x < 8 + SCALE_COUNT)
+        shared.scale = x - 8;
+    else if ((y == 1 || y == 2) && x < 15 && root_keys[y - 1][x - 8] >= 0)
+        shared.root = root_keys[y - 1][x - 8];
+    else if (y == 4 && x < 8 + TUNING_COUNT)
+        shared.tuning = x - 8;
+    else
+        return;
+    
+    update_pitch_table();
+    refresh(DIRTY_SETTINGS);
+}
+
+// ----------------------------------------------------------------------------
+// diagnostics
+
+// one bar per row on a log scale, each LED doubles the value: clock edges
+// per second, worst step() in us, events per second, worst event in us,
+// renders per second, worst render in us, coalesced refreshes per second
+// and the most events between two render timers
+void render_diagnostics() {
+    u32 values[DIAGNOSTICS_ROWS] = {
+        diag_clock.last_count, diag_clock.last_peak / CYCLES_PER_US,
+        diag_event.last_count, diag_event.last_peak / CYCLES_PER_US,
+        diag_render.last_count, diag_render.last_peak / CYCLES_PER_US,
+        diag_coalesced.last_count, diag_frame_events.last_peak
+    };
+    
+    for (u8 y = 0; y < DIAGNOSTICS_ROWS; y++) {
+        u8 length = bit_length(values[y]);
+        for (u8 x = 2; x < GRID_COLUMNS; x++)
+            set_led(x, y, x - 2 < length ? LED_DIAGNOSTICS_ON : LED_DIAGNOSTICS_OFF);
+    }
+}
+
+// any key starts the counts over
+void grid_press_diagnostics(u8 x, u8 y, u8 pressed) {
+    if (!pressed) return;
+    
+    reset_diagnostics();
+    refresh(DIRTY_SETTINGS);
+}
+
+void reset_diagnostics() {
+    window_reset(&diag_clock);
+    window_reset(&diag_event);
+    window_reset(&diag_render);
+    window_reset(&diag_coalesced);
+    window_reset(&diag_frame_events);
+    diag_window_start = get_global_time();
+    frame_events = 0;
+}
+
+void roll_diagnostics() {
+    window_roll(&diag_clock);
+    window_roll(&diag_event);
+    window_roll(&diag_render);
+    window_roll(&diag_coalesced);
+    window_roll(&diag_frame_events);
+    diag_window_start = get_global_time();
+    if (page == PAGE_DIAGNOSTICS) refresh(DIRTY_SETTINGS);
+}
+
 // ----------------------------------------------------------------------------
 // tracker
 
-void render_tracker() {
-    render_tracker_menu();
-    render_tracker_tracker();
+void render_tracker(u8 dirty) {
+    if (dirty & DIRTY_TRACKER_MENU) render_tracker_menu();
+    if (dirty & DIRTY_TRACKER) render_tracker_tracker();
 }
 
 void grid_press_tracker(u8 x, u8 y, u8 pressed) {
-    if (x < 8) {
+    if (x < TRACKER_X) {
         grid_press_tracker_menu(x, y, pressed);
         return;
     }
@@ -231,71 +1034,102 @@ void grid_press_tracker(u8 x, u8 y, u8 pressed) {
 // tracker menu
 
 void render_tracker_menu() {
-    set_grid_led(5, 0, tracker_dir == TRACKER_DIR_V ? LED_MENU_ON : LED_MENU_OFF);
-    set_grid_led(6, 0, follow_tracker_page ? LED_MENU_ON : LED_MENU_OFF);
-    set_grid_led(5, 7, keyboard_on ? LED_MENU_ON : LED_MENU_OFF);
+    set_led(5, 0, tracker_dir == TRACKER_DIR_V ? LED_MENU_ON : LED_MENU_OFF);
+    set_led(6, 0, follow_tracker_page ? LED_MENU_ON : LED_MENU_OFF);
+    set_led(5, BOTTOM_ROW, keyboard_on ? LED_MENU_ON : LED_MENU_OFF);
+    set_led(2, 0, history.undo_count ? LED_MENU_ON : LED_MENU_OFF);
+    set_led(2, 1, history.redo_count ? LED_MENU_ON : LED_MENU_OFF);
+    set_led(2, BOTTOM_ROW - 1, LED_MENU_OFF);
+    set_led(2, BOTTOM_ROW, LED_MENU_OFF);
     
     if (recording_mode == RECORDING_OFF)
-        set_grid_led(6, 7, LED_RECORDING_OFF);
+        set_led(6, BOTTOM_ROW, LED_RECORDING_OFF);
     else if (recording_mode == RECORDING_ARMED)
-        set_grid_led(6, 7, recording_led ? LED_RECORDING_ARMED_1 : LED_RECORDING_ARMED_2);
+        set_led(6, BOTTOM_ROW, recording_led ? LED_RECORDING_ARMED_1 : LED_RECORDING_ARMED_2);
     else
-        set_grid_led(6, 7, recording_led ? LED_RECORDING_ON_1 : LED_RECORDING_ON_2);
+        set_led(6, BOTTOM_ROW, recording_led ? LED_RECORDING_ON_1 : LED_RECORDING_ON_2);
 
-    u8 playing_page = e_get_current_step(&pattern) / TRACKER_LINES;
+    for (u8 y = 0; y < PATTERN_COUNT; y++) {
+        if (y == playing_index)
+            set_led(3, y, LED_PATTERN_PLAYING);
+        else if (y == queued_index)
+            set_led(3, y, LED_PATTERN_QUEUED);
+        else
+            set_led(3, y, y == edited_index ? LED_PATTERN_EDITED : LED_PATTERN_OFF);
+    }
+    
+    u8 playing_page = e_get_voice_step(&voices, 0) / TRACKER_LINES;
     
     for (u8 y = 0; y < tracker_page_count; y++) {
-        set_grid_led(5, y + tracker_selector_y1, y == playing_page ? LED_MENU_ON : LED_MENU_OFF);
-        set_grid_led(6, y + tracker_selector_y1, y == tracker_page ? LED_MENU_ON : LED_MENU_OFF);
+        set_led(5, y + tracker_selector_y1, y == playing_page ? LED_MENU_ON : LED_MENU_OFF);
+        set_led(6, y + tracker_selector_y1, y == tracker_page ? LED_MENU_ON : LED_MENU_OFF);
     }
 }
 
 void grid_press_tracker_menu(u8 x, u8 y, u8 pressed) {
     if (!pressed) return;
     
-    if (x == 5 && y == 0) {
+    if (x == 3 && y < PATTERN_COUNT) {
+        select_pattern(y);
+        refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
+    }
+    
+    else if (x == 2 && y == 0) {
+        undo();
+    }
+    
+    else if (x == 2 && y == 1) {
+        redo();
+    }
+    
+    // a new random pattern, or the last one again with the current settings
+    else if (x == 2 && (y == BOTTOM_ROW - 1 || y == BOTTOM_ROW)) {
+        generate(y == BOTTOM_ROW);
+    }
+    
+    else if (x == 5 && y == 0) {
         tracker_dir = tracker_dir == TRACKER_DIR_V ? TRACKER_DIR_H : TRACKER_DIR_V;
-        refresh_grid();
+        refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
     }
     
     else if (x == 6 && y == 0) {
         follow_tracker_page = !follow_tracker_page;
-        refresh_grid();
+        refresh(DIRTY_TRACKER_MENU);
     }
     
-    else if (x == 5 && y == 7) {
+    else if (x == 5 && y == BOTTOM_ROW) {
         keyboard_on = !keyboard_on;
         if (!keyboard_on) {
-            recording_mode = RECORDING_OFF;
+            set_recording_mode(RECORDING_OFF);
         }
-        refresh_grid();
+        refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
     }
     
-    else if (x == 6 && y == 7) {
+    else if (x == 6 && y == BOTTOM_ROW) {
         if (recording_mode == RECORDING_OFF) {
-            recording_mode = RECORDING_ARMED;
+            set_recording_mode(RECORDING_ARMED);
         } else if (recording_mode == RECORDING_ARMED) {
-            recording_mode = RECORDING_ON;
+            set_recording_mode(RECORDING_ON);
         } else {
-            recording_mode = RECORDING_OFF;
+            set_recording_mode(RECORDING_OFF);
         }
         if (recording_mode != RECORDING_OFF) {
             keyboard_on = 1;
         }
-        refresh_grid();
+        refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
     }
 
     else if (x == 5 && y >= tracker_selector_y1 && y <= tracker_selector_y2) {
         u8 page = y - tracker_selector_y1;
-        s8 new_step = (e_get_current_step(&pattern) % TRACKER_LINES) + page * TRACKER_LINES;
-        e_set_current_step(&pattern, new_step);
-        refresh_grid();
+        s8 new_step = (e_get_voice_step(&voices, 0) % TRACKER_LINES) + page * TRACKER_LINES;
+        e_set_voice_step(&voices, 0, new_step);
+        refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
     }
 
     else if (x == 6 && y >= tracker_selector_y1 && y <= tracker_selector_y2) {
         tracker_page = y - tracker_selector_y1;
         tracker_start_step = tracker_page * TRACKER_LINES;
-        refresh_grid();
+        refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
     }
 }
     
@@ -305,7 +1139,8 @@ void grid_press_tracker_menu(u8 x, u8 y, u8 pressed) {
 void render_tracker_tracker() {
     u8 value, gate, step, led_on, led_off, x, y;
     s8 pitch;
-    u8 current_step = e_get_current_step(&pattern);
+    u32 used_pitches;
+    u8 current_step = e_get_voice_step(&voices, 0);
     u8 show_keyboard = keyboard_on || edited_step != NO_STEP;
     
     if (tracker_dir == TRACKER_DIR_V) { // ||||||||
@@ -317,235 +1152,253 @@ void render_tracker_tracker() {
             led_off = step == current_step ? LED_TRIGGER_OFF_2 : LED_TRIGGER_OFF_1;
             
             // octave shift
-            value = e_get_transpose(&pattern, step);
-            set_grid_led(8, y, value == TRANSPOSE_DOWN ? led_on : led_off);
-            set_grid_led(10, y, value == TRANSPOSE_UP ? led_on : led_off);
+            value = e_get_transpose(pattern, step);
+            set_led(TRACKER_X, y, value == TRANSPOSE_DOWN ? led_on : led_off);
+            set_led(TRACKER_X + 2, y, value == TRANSPOSE_UP ? led_on : led_off);
             
-            gate = e_get_gate(&pattern, step);
+            gate = e_get_gate(pattern, step);
 
             // pitch
             if (step == edited_step)
-                set_grid_led(9, y, led_on);
+                set_led(TRACKER_X + 1, y, led_on);
             else if (gate != GATE_REST)
-                set_grid_led(9, y, step == current_step ? LED_TRIGGER_GATE_2 : LED_TRIGGER_GATE_1);
+                set_led(TRACKER_X + 1, y, step == current_step ? LED_TRIGGER_GATE_2 : LED_TRIGGER_GATE_1);
             else
-                set_grid_led(9, y, step == current_step ? LED_TRIGGER_OFF_2 : LED_TRIGGER_OFF_1);
+                set_led(TRACKER_X + 1, y, step == current_step ? LED_TRIGGER_OFF_2 : LED_TRIGGER_OFF_1);
 
             // resets
-            if (e_get_reset(&pattern, step)) set_grid_led(11, y, led_on);
+            if (e_get_reset(pattern, step)) set_led(TRACKER_X + 3, y, led_on);
             
             if (!show_keyboard) {
                 // gate
-                set_grid_led(12, y, gate == GATE_ON ? led_on : led_off);
-                set_grid_led(13, y, gate == GATE_TIE ? led_on : led_off);
+                set_led(TRACKER_X + 4, y, gate == GATE_ON ? led_on : led_off);
+                set_led(TRACKER_X + 5, y, gate == GATE_TIE ? led_on : led_off);
                 
                 // accent/slide
-                set_grid_led(14, y, e_get_accent(&pattern, step) == GATE_ON ? led_on : led_off);
-                set_grid_led(15, y, e_get_slide(&pattern, step) == GATE_ON ? led_on : led_off);
+                set_led(TRACKER_X + 6, y, e_get_accent(pattern, step) == GATE_ON ? led_on : led_off);
+                set_led(TRACKER_X + 7, y, e_get_slide(pattern, step) == GATE_ON ? led_on : led_off);
             }
         }
         
         if (show_keyboard) {
-            set_grid_led(12, 3, LED_KEYBOARD_REST);
-            set_grid_led(12, 4, LED_KEYBOARD_REST);
+            set_led(TRACKER_X + 4, 3, LED_KEYBOARD_REST);
+            set_led(TRACKER_X + 4, 4, LED_KEYBOARD_REST);
+            
+            if (edited_step != NO_STEP) {
+                value = e_get_ratchet(pattern, edited_step);
+                for (u8 y = 0; y < MAX_RATCHETS - 1; y++)
+                    set_led(TRACKER_X + 4, y, value == y + 2 ? LED_RATCHET_ON : LED_RATCHET_OFF);
+            } else if (recording_mode == RECORDING_ON) {
+                set_led(TRACKER_X + 4, 0, record_accent ? LED_RATCHET_ON : LED_RATCHET_OFF);
+            }
 
-            for (u8 x = 13; x < 16; x++)
-                for (u8 y = 0; y < 8; y++) set_grid_led(x, y, LED_KEYBOARD_OFF);
+            // the keyboard covers the top block, the columns below stay empty
+            for (u8 x = TRACKER_X + 5; x < GRID_COLUMNS; x++)
+                for (u8 y = 0; y < TRACKER_BLOCK; y++) set_led(x, y, LED_KEYBOARD_OFF);
             
             // all pitches used in current pattern
-            for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++)
-                if (e_get_gate(&pattern, i) != GATE_REST) {
-                    pitch = e_get_pitch(&pattern, i);
-                    x = 15 - (pitch >> 3);
+            used_pitches = e_get_used_pitches(pattern);
+            for (pitch = 0; pitch <= MAX_PITCH_VALUE; pitch++)
+                if (used_pitches & (1UL << pitch)) {
+                    x = GRID_COLUMNS - 1 - (pitch >> 3);
                     y = 7 - (pitch & 7);
-                    set_grid_led(x, y, LED_KEYBOARD_USED);
+                    set_led(x, y, LED_KEYBOARD_USED);
                 }
                 
             // current step
             step = current_step - tracker_start_step;
-            if (e_get_current_gate(&pattern) != GATE_REST && step >= 0 && step < TRACKER_LINES) {
-                pitch = e_get_current_pitch(&pattern);
-                x = 15 - (pitch >> 3);
+            if (e_get_gate(pattern, current_step) != GATE_REST && step >= 0 && step < TRACKER_LINES) {
+                pitch = e_get_pitch(pattern, current_step);
+                x = GRID_COLUMNS - 1 - (pitch >> 3);
                 y = 7 - (pitch & 7);
-                set_grid_led(x, y, LED_KEYBOARD_CURRENT);
+                set_led(x, y, LED_KEYBOARD_CURRENT);
             }
 
             // pressed note pitch
             if (edited_step != NO_STEP) {
-                pitch = e_get_pitch(&pattern, edited_step);
-                x = 15 - (pitch >> 3);
+                pitch = e_get_pitch(pattern, edited_step);
+                x = GRID_COLUMNS - 1 - (pitch >> 3);
                 y = 7 - (pitch & 7);
-                set_grid_led(x, y, LED_KEYBOARD_STEP);
+                set_led(x, y, LED_KEYBOARD_STEP);
             }
             
             // keyboard note
             if (keyboard_note != -1) {
-                x = 15 - (keyboard_note >> 3);
+                x = GRID_COLUMNS - 1 - (keyboard_note >> 3);
                 y = 7 - (keyboard_note & 7);
-                set_grid_led(x, y, LED_KEYBOARD_NOTE);
+                set_led(x, y, LED_KEYBOARD_NOTE);
             }
         }
 
     } else { // ========
         
-        for (u8 x = 8; x < 8 + TRACKER_LINES; x++) {
+        for (u8 line = 0; line < TRACKER_LINES; line++) {
             
-            step = x + tracker_start_step - 8;
+            // each block of 8 steps takes 8 rows, y is the top row of the block
+            step = line + tracker_start_step;
+            x = TRACKER_X + line % TRACKER_BLOCK;
+            y = line / TRACKER_BLOCK * TRACKER_BLOCK;
             led_on = step == current_step ? LED_TRIGGER_ON_2 : LED_TRIGGER_ON_1;
             led_off = step == current_step ? LED_TRIGGER_OFF_2 : LED_TRIGGER_OFF_1;
             
             // octave shift
-            value = e_get_transpose(&pattern, step);
-            set_grid_led(x, 0, value == TRANSPOSE_UP ? led_on : led_off);
-            set_grid_led(x, 2, value == TRANSPOSE_DOWN ? led_on : led_off);
+            value = e_get_transpose(pattern, step);
+            set_led(x, y, value == TRANSPOSE_UP ? led_on : led_off);
+            set_led(x, y + 2, value == TRANSPOSE_DOWN ? led_on : led_off);
             
-            gate = e_get_gate(&pattern, step);
+            gate = e_get_gate(pattern, step);
 
             // pitch
             if (step == edited_step)
-                set_grid_led(x, 1, led_on);
+                set_led(x, y + 1, led_on);
             else if (gate != GATE_REST)
-                set_grid_led(x, 1, step == current_step ? LED_TRIGGER_GATE_2 : LED_TRIGGER_GATE_1);
+                set_led(x, y + 1, step == current_step ? LED_TRIGGER_GATE_2 : LED_TRIGGER_GATE_1);
             else
-                set_grid_led(x, 1, step == current_step ? LED_TRIGGER_OFF_2 : LED_TRIGGER_OFF_1);
+                set_led(x, y + 1, step == current_step ? LED_TRIGGER_OFF_2 : LED_TRIGGER_OFF_1);
 
             
             // resets
-            if (e_get_reset(&pattern, step)) set_grid_led(x, 3, led_on);
+            if (e_get_reset(pattern, step)) set_led(x, y + 3, led_on);
             
-            if (!show_keyboard) {
+            // the keyboard covers the bottom half of the last block
+            if (!show_keyboard || y != GRID_ROWS - TRACKER_BLOCK) {
                 // gate
-                set_grid_led(x, 4, gate == GATE_ON ? led_on : led_off);
-                set_grid_led(x, 5, gate == GATE_TIE ? led_on : led_off);
+                set_led(x, y + 4, gate == GATE_ON ? led_on : led_off);
+                set_led(x, y + 5, gate == GATE_TIE ? led_on : led_off);
                 
                 // accent/slide
-                set_grid_led(x, 6, e_get_accent(&pattern, step) == GATE_ON ? led_on : led_off);
-                set_grid_led(x, 7, e_get_slide(&pattern, step) == GATE_ON ? led_on : led_off);
+                set_led(x, y + 6, e_get_accent(pattern, step) == GATE_ON ? led_on : led_off);
+                set_led(x, y + 7, e_get_slide(pattern, step) == GATE_ON ? led_on : led_off);
             }
         }
 
         if (show_keyboard) {
-            set_grid_led(11, 4, LED_KEYBOARD_REST);
-            set_grid_led(12, 4, LED_KEYBOARD_REST);
+            set_led(TRACKER_X + 3, BOTTOM_ROW - 3, LED_KEYBOARD_REST);
+            set_led(TRACKER_X + 4, BOTTOM_ROW - 3, LED_KEYBOARD_REST);
+            
+            if (edited_step != NO_STEP) {
+                value = e_get_ratchet(pattern, edited_step);
+                for (u8 x = 0; x < MAX_RATCHETS - 1; x++)
+                    set_led(TRACKER_X + x, BOTTOM_ROW - 3, value == x + 2 ? LED_RATCHET_ON : LED_RATCHET_OFF);
+            } else if (recording_mode == RECORDING_ON) {
+                set_led(TRACKER_X, BOTTOM_ROW - 3, record_accent ? LED_RATCHET_ON : LED_RATCHET_OFF);
+            }
 
-            for (u8 x = 8; x < 16; x++)
-                for (u8 y = 5; y < 8; y++) set_grid_led(x, y, LED_KEYBOARD_OFF);
+            for (u8 x = TRACKER_X; x < GRID_COLUMNS; x++)
+                for (u8 y = BOTTOM_ROW - 2; y < GRID_ROWS; y++) set_led(x, y, LED_KEYBOARD_OFF);
             
             // all pitches used in current pattern
-            for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++)
-                if (e_get_gate(&pattern, i) != GATE_REST) {
-                    pitch = e_get_pitch(&pattern, i);
-                    x = 8 + (pitch & 7);
-                    y = 7 - (pitch >> 3);
-                    set_grid_led(x, y, LED_KEYBOARD_USED);
+            used_pitches = e_get_used_pitches(pattern);
+            for (pitch = 0; pitch <= MAX_PITCH_VALUE; pitch++)
+                if (used_pitches & (1UL << pitch)) {
+                    x = TRACKER_X + (pitch & 7);
+                    y = BOTTOM_ROW - (pitch >> 3);
+                    set_led(x, y, LED_KEYBOARD_USED);
                 }
             
             // current step
             step = current_step - tracker_start_step;
-            if (e_get_current_gate(&pattern) != GATE_REST && step >= 0 && step < TRACKER_LINES) {
-                pitch = e_get_current_pitch(&pattern);
-                x = 8 + (pitch & 7);
-                y = 7 - (pitch >> 3);
-                set_grid_led(x, y, LED_KEYBOARD_CURRENT);
+            if (e_get_gate(pattern, current_step) != GATE_REST && step >= 0 && step < TRACKER_LINES) {
+                pitch = e_get_pitch(pattern, current_step);
+                x = TRACKER_X + (pitch & 7);
+                y = BOTTOM_ROW - (pitch >> 3);
+                set_led(x, y, LED_KEYBOARD_CURRENT);
             }
 
             // pressed note pitch
             if (edited_step != NO_STEP) {
-                pitch = e_get_pitch(&pattern, edited_step);
-                x = 8 + (pitch & 7);
-                y = 7 - (pitch >> 3);
-                set_grid_led(x, y, LED_KEYBOARD_STEP);
+                pitch = e_get_pitch(pattern, edited_step);
+                x = TRACKER_X + (pitch & 7);
+                y = BOTTOM_ROW - (pitch >> 3);
+                set_led(x, y, LED_KEYBOARD_STEP);
             }
             
             // keyboard note
             if (keyboard_note != -1) {
-                x = 8 + (keyboard_note & 7);
-                y = 7 - (keyboard_note >> 3);
-                set_grid_led(x, y, LED_KEYBOARD_NOTE);
+                x = TRACKER_X + (keyboard_note & 7);
+                y = BOTTOM_ROW - (keyboard_note >> 3);
+                set_led(x, y, LED_KEYBOARD_NOTE);
             }
         }
     }
 }
 
 void grid_press_tracker_tracker(u8 x, u8 y, u8 pressed) {
-    u8 value;
-    x -= 8;
+    u8 value, step, keyboard_area = 1;
+    x -= TRACKER_X;
+    
+    // x becomes the column in the vertical layout and y the line in a block,
+    // the horizontal keyboard only covers the last block
     if (tracker_dir == TRACKER_DIR_H) {
+        step = y / TRACKER_BLOCK * TRACKER_BLOCK + x + tracker_start_step;
+        keyboard_area = y >= GRID_ROWS - TRACKER_BLOCK;
         value = x;
-        x = y;
+        x = y % TRACKER_BLOCK;
         y = value;
+    } else {
+        step = y + tracker_start_step;
     }
     
-    u8 step = y + tracker_start_step;
-    
     if (x == 0) {
         if (!pressed) return;
         value = tracker_dir == TRACKER_DIR_V ? TRANSPOSE_DOWN : TRANSPOSE_UP;
-        e_set_transpose(&pattern, step, e_get_transpose(&pattern, step) == value ? TRANSPOSE_OFF : value);
-        refresh_grid();
+        edit_step(step, HISTORY_TRANSPOSE, e_get_transpose(pattern, step) == value ? TRANSPOSE_OFF : value);
+        refresh(DIRTY_TRACKER);
         return;
     }
     
     if (x == 2) {
         if (!pressed) return;
         value = tracker_dir == TRACKER_DIR_V ? TRANSPOSE_UP : TRANSPOSE_DOWN;
-        e_set_transpose(&pattern, step, e_get_transpose(&pattern, step) == value ? TRANSPOSE_OFF : value);
-        refresh_grid();
+        edit_step(step, HISTORY_TRANSPOSE, e_get_transpose(pattern, step) == value ? TRANSPOSE_OFF : value);
+        refresh(DIRTY_TRACKER);
         return;
     }
     
     if (x == 3) {
         if (!pressed) return;
-        e_set_reset(&pattern, step, !e_get_reset(&pattern, step));
-        refresh_grid();
+        edit_step(step, HISTORY_RESET, !e_get_reset(pattern, step));
+        refresh(DIRTY_TRACKER);
         return;
     }
     
     if (x == 1) {
         if (pressed) {
-            edited_step = step;
-            if (!seq_on) e_set_current_step(&pattern, step);
-        } else {
-            if (edited_step == step) edited_step = NO_STEP;
+            edited_step = arc_step = step;
+            refresh_arc_rings(1 << ARC_RING_STEP | 1 << ARC_RING_PITCH);
+            history_start_group(&history);
+            if (!seq_on) e_set_voice_step(&voices, 0, step);
+        } else if (edited_step == step) {
+            edited_step = NO_STEP;
+            history_end_group(&history);
         }
-        refresh_grid();
+        refresh(DIRTY_TRACKER);
         return;
     }
     
-    if (keyboard_on || edited_step != NO_STEP) { // keyboard note selection
-        if (x == 4) { // rest
-            if ((y != 3 && y != 4) || !pressed) return;
-            e_set_gate(&pattern, edited_step, GATE_REST);
-            refresh_grid();
-            return;
-        }
-        
-        if (tracker_dir == TRACKER_DIR_H) y = 7 - y;
-        u8 note = 7 - y + ((7 - x) << 3);
-        
-        if (pressed) {
-            if (edited_step != NO_STEP) {
-                e_set_pitch(&pattern, edited_step, note);
-                e_set_gate(&pattern, edited_step, GATE_ON);
-                set_cv(0, note_to_pitch(e_get_pitch_transposed(&pattern, edited_step) + TRANSPOSE_OUTPUT));
-                set_gate(0, 1);
-            } else {
-                keyboard_note = note;
-                set_cv(0, note_to_pitch(note + TRANSPOSE_OUTPUT));
-                set_gate(0, 1);
+    if ((keyboard_on || edited_step != NO_STEP) && keyboard_area) { // keyboard note selection
+        if (x == 4) { // ratchets and rest, the first ratchet key is accent while recording
+            if (y == 0 && edited_step == NO_STEP && recording_mode == RECORDING_ON) {
+                record_accent = pressed;
+                refresh(DIRTY_TRACKER);
+                return;
             }
-        } else {
-            if (edited_step != NO_STEP) {
-                if (!seq_on) set_gate(0, 0);
+            if (!pressed) return;
+            if (y < MAX_RATCHETS - 1 && edited_step != NO_STEP) {
+                value = y + 2;
+                edit_step(edited_step, HISTORY_RATCHET, e_get_ratchet(pattern, edited_step) == value ? 1 : value);
+            } else if (y == 3 || y == 4) {
+                edit_step(edited_step, HISTORY_GATE, GATE_REST);
             } else {
-                if (note == keyboard_note) {
-                    if (!seq_on) set_gate(0, 0);
-                    keyboard_note = -1;
-                }
+                return;
             }
+            refresh(DIRTY_TRACKER);
+            return;
         }
         
-        refresh_grid();
+        if (y >= TRACKER_BLOCK) return;
+        if (tracker_dir == TRACKER_DIR_H) y = 7 - y;
+        play_note(7 - y + ((7 - x) << 3), pressed);
         return;
     }
     
@@ -553,48 +1406,991 @@ void grid_press_tracker_tracker(u8 x, u8 y, u8 pressed) {
 
     switch (x) {
         case 4:
-            value = e_get_gate(&pattern, step);
-            e_set_gate(&pattern, step, value == GATE_ON ? GATE_REST : GATE_ON);
+            value = e_get_gate(pattern, step);
+            edit_step(step, HISTORY_GATE, value == GATE_ON ? GATE_REST : GATE_ON);
             break;
         case 5:
-            value = e_get_gate(&pattern, step);
-            e_set_gate(&pattern, step, value == GATE_TIE ? GATE_REST : GATE_TIE);
+            value = e_get_gate(pattern, step);
+            edit_step(step, HISTORY_GATE, value == GATE_TIE ? GATE_REST : GATE_TIE);
             break;
         case 6:
-            e_set_accent(&pattern, step, !e_get_accent(&pattern, step));
+            edit_step(step, HISTORY_ACCENT, !e_get_accent(pattern, step));
             break;
         case 7:
-            e_set_slide(&pattern, step, !e_get_slide(&pattern, step));
+            edit_step(step, HISTORY_SLIDE, !e_get_slide(pattern, step));
             break;
         default:
             break;
     }
         
-    refresh_grid();
+    refresh(DIRTY_TRACKER);
+}
+
+// sets the pitch of the held step or plays the note, from the grid or midi
+void play_note(u8 note, u8 pressed) {
+    if (pressed) {
+        if (edited_step != NO_STEP) {
+            edit_step(edited_step, HISTORY_PITCH, note);
+            edit_step(edited_step, HISTORY_GATE, GATE_ON);
+            set_pitch(pitch_to_dac(e_get_pitch(pattern, edited_step), e_get_transpose(pattern, edited_step)));
+            set_midi_note(e_get_pitch(pattern, edited_step), e_get_transpose(pattern, edited_step), 0);
+            set_main_gate(1);
+        } else {
+            keyboard_note = note;
+            set_pitch(pitch_to_dac(note, TRANSPOSE_OFF));
+            set_midi_note(note, TRANSPOSE_OFF, 0);
+            set_main_gate(1);
+            if (recording_mode == RECORDING_ON) recorder_push(&recorder, get_global_time(), note, record_accent);
+        }
+    } else {
+        if (edited_step != NO_STEP) {
+            if (!seq_on) set_main_gate(0);
+        } else {
+            if (note == keyboard_note) {
+                if (!seq_on) set_main_gate(0);
+                keyboard_note = -1;
+                if (recording_mode == RECORDING_ON) recorder_push(&recorder, get_global_time(), RECORDER_RELEASE, 0);
+            }
+        }
+    }
+    
+    refresh(DIRTY_TRACKER);
 }
 
 // ----------------------------------------------------------------------------
 // sequencer
 
+void clock_edge(u8 on) {
+    clock_event_time = get_cycles();
+    if (on) {
+        measure_clock();
+        step();
+        window_peak(&diag_clock, get_cycles() - clock_event_time);
+    } else {
+        step_off();
+    }
+    window_count(&diag_clock);
+}
+
+// notes play like the keyboard, starting at the lowest octave
+void receive_note(u8 note, u8 on) {
+    if (note >= TRANSPOSE_OUTPUT && note <= TRANSPOSE_OUTPUT + MAX_PITCH_VALUE)
+        play_note(note - TRANSPOSE_OUTPUT, on);
+}
+
+// one midi clock tick, the gate closes halfway through the step
+void midi_clock() {
+    if (!midi_clock_running) return;
+    
+    u8 divider = midi_dividers[shared.midi_divider];
+    if (midi_clock_tick >= divider) midi_clock_tick = 0;
+    
+    if (!midi_clock_tick) clock_edge(1);
+    else if (midi_clock_tick == divider >> 1) clock_edge(0);
+    
+    if (++midi_clock_tick >= divider) midi_clock_tick = 0;
+}
+
 void step() {
     if (!seq_on) return;
     
-    e_step(&pattern);
-    set_cv(0, note_to_pitch(e_get_current_pitch_transposed(&pattern) + TRANSPOSE_OUTPUT));
-    set_gate(0, e_get_current_gate(&pattern) != GATE_REST);
-    set_gate(1, e_get_current_accent(&pattern));
-    set_gate(2, e_get_current_slide(&pattern));
+    u8 swapped = edit_pending;
+    commit_edits();
+    
+    u8 prev_step = e_get_voice_step(&voices, 0);
+    if ((e_step_all(&voices) & 1) && queued_index != NO_PATTERN) {
+        playing_index = queued_index;
+        playing = patterns[playing_index];
+        queued_index = NO_PATTERN;
+        
+        // all voices start over with the new patterns
+        assign_voices();
+        for (u8 v = 0; v < e_get_voice_count(&voices); v++) e_set_voice_step(&voices, v, 0);
+        update_edited_pattern();
+        swapped = 1;
+    }
+    
+    // anything left over belongs to the previous step, a gate that is still
+    // waiting for its scheduled end gets closed now
+    if (wheel_count(&wheel)) {
+        if (e_get_gate(playing, prev_step) == GATE_ON) set_main_gate(0);
+        wheel_clear(&wheel);
+    }
+    
+    step_delay = e_get_voice_step(&voices, 0) & 1 ? (u32)clock_period * shared.swing >> 4 : 0;
+    if (step_delay) {
+        schedule(step_delay, SUB_STEP_OUTPUT);
+    } else {
+        output_step();
+        latency_record(&clock_latency, get_cycles() - clock_event_time);
+    }
+    
+    // everything below is ui work
+    u8 current_step = e_get_voice_step(&voices, 0);
+    u8 dirty = swapped ? DIRTY_TRACKER_MENU | DIRTY_TRACKER : 0;
+    
+    // armed recording starts with the pattern, notes captured since the
+    // last step are written against that step's clock edge
+    if (recording_mode == RECORDING_ARMED && !current_step) {
+        set_recording_mode(RECORDING_ON);
+        dirty |= DIRTY_TRACKER_MENU | DIRTY_TRACKER;
+    }
+    if (record_notes()) dirty |= DIRTY_TRACKER;
+    refresh_arc_rings(1 << ARC_RING_STEP);
+    record_clock_time = tempo.last_edge;
+    record_prev_step = record_clock_step;
+    record_clock_step = current_step;
+    
+    if (prev_step / TRACKER_LINES != current_step / TRACKER_LINES) dirty |= DIRTY_TRACKER_MENU;
     
-    if (follow_tracker_page) {
-        tracker_page = e_get_current_step(&pattern) / TRACKER_LINES;
+    if (follow_tracker_page && tracker_page != current_step / TRACKER_LINES) {
+        tracker_page = current_step / TRACKER_LINES;
         tracker_start_step = tracker_page * TRACKER_LINES;
+        dirty |= DIRTY_TRACKER_MENU | DIRTY_TRACKER;
     }
+    
+    // the playhead only shows in the tracker when it's on the visible page
+    if ((u8)(prev_step - tracker_start_step) < TRACKER_LINES ||
+        (u8)(current_step - tracker_start_step) < TRACKER_LINES) dirty |= DIRTY_TRACKER;
 
-    refresh_grid();
+    if (dirty) refresh(dirty);
 }
 
 void step_off() {
     if (!seq_on) return;
     
-    if (e_get_current_gate(&pattern) != GATE_TIE) set_gate(0, 0);
+    // a swung step ends as late as it started
+    if (step_delay) {
+        schedule(step_delay, SUB_STEP_OFF);
+        return;
+    }
+    
+    output_step_off();
+    latency_record(&clock_off_latency, get_cycles() - clock_event_time);
+    prepare_next_step();
+}
+
+// a slide step glides cv into the next gated step. with [1] off the slide
+// flag belongs to the step it glides into instead, which needs to know
+// about the next step of voice 0 before it plays.
+static u8 get_slide_next(const u8 settings, engine_lookahead_t *la) {
+    if (la->s.gate == GATE_REST) return 0;
+    if (settings & SETTING_303_SLIDE) return la->s.slide;
+    return la->next_slide && la->next_gate != GATE_REST;
+}
+
+// settings is always a constant, see OUTPUT_STEP_KERNEL
+static inline __attribute__((always_inline)) void output_step_kernel(const u8 settings) {
+    engine_lookahead_t *la = get_step(0);
+    u8 gate = la->s.gate;
+    u8 accent = la->s.accent;
+    u8 slide_flag = la->s.slide;
+    
+    set_midi_note(la->s.pitch, la->s.transpose, accent);
+    
+    if (slide_next && shared.slide_time && gate != GATE_REST) output_pitch(lookahead_dac[0]);
+    else set_pitch(lookahead_dac[0]);
+    set_main_gate(gate != GATE_REST);
+    
+    // [2] keeps the accent of the last played note through ties and rests,
+    // [4] shows the slide flag on ties and rests as well
+    if (e_get_voice_count(&voices) < 2 && (!(settings & SETTING_HOLD_ACCENT) || gate == GATE_ON))
+        set_gate(1, accent);
+    if (e_get_voice_count(&voices) < 3)
+        set_gate(2, settings & SETTING_SLIDE_ON_TIES ? slide_flag : slide_flag && gate == GATE_ON);
+    
+    for (u8 v = 1; v < e_get_voice_count(&voices); v++) {
+        u8 voice_gate = get_step(v)->s.gate;
+        set_cv(v, lookahead_dac[v]);
+        set_gate(v, voice_gate != GATE_REST);
+    }
+    
+    // [3] holds the gate into the slide, otherwise only cv glides
+    slide_next = get_slide_next(settings, la);
+    gate_held = gate == GATE_TIE || (settings & SETTING_GATE_BEFORE_SLIDE && slide_next);
+    gate_timed = 0;
+    
+    // ties and slides hold the gate and a gate without a known clock period
+    // can only follow the clock
+    if (gate != GATE_ON || gate_held || !clock_period) return;
+    
+    u8 ratchets = la->s.ratchet;
+    u16 length = clock_period / ratchets;
+    u16 gate_length = (u32)length * (shared.gate_length ? shared.gate_length : MAX_GATE_LENGTH >> 1) / MAX_GATE_LENGTH;
+    
+    // each ratchet has to close before the next one opens
+    if (gate_length >= length) gate_length = length - 1;
+    if (!gate_length) gate_length = 1;
+    
+    // ratchets always close on time, the clock could end the step while the
+    // last one is opening
+    gate_timed = shared.gate_length || ratchets > 1;
+    if (!gate_timed) return;
+    
+    for (u8 i = 0; i < ratchets; i++) {
+        if (i) schedule(i * length, SUB_GATE_ON);
+        schedule(i * length + gate_length, SUB_GATE_OFF);
+    }
+}
+
+#define OUTPUT_STEP_KERNEL(n) static void output_step_##n(void) { output_step_kernel(n); }
+OUTPUT_STEP_KERNEL(0)  OUTPUT_STEP_KERNEL(1)  OUTPUT_STEP_KERNEL(2)  OUTPUT_STEP_KERNEL(3)
+OUTPUT_STEP_KERNEL(4)  OUTPUT_STEP_KERNEL(5)  OUTPUT_STEP_KERNEL(6)  OUTPUT_STEP_KERNEL(7)
+OUTPUT_STEP_KERNEL(8)  OUTPUT_STEP_KERNEL(9)  OUTPUT_STEP_KERNEL(10) OUTPUT_STEP_KERNEL(11)
+OUTPUT_STEP_KERNEL(12) OUTPUT_STEP_KERNEL(13) OUTPUT_STEP_KERNEL(14) OUTPUT_STEP_KERNEL(15)
+
+static void (* const output_step_kernels[SETTING_303_COMBINATIONS])(void) = {
+    output_step_0,  output_step_1,  output_step_2,  output_step_3,
+    output_step_4,  output_step_5,  output_step_6,  output_step_7,
+    output_step_8,  output_step_9,  output_step_10, output_step_11,
+    output_step_12, output_step_13, output_step_14, output_step_15
+};
+
+#ifdef OUTPUT_STEP_GENERIC
+static void output_step_any(void) {
+    output_step_kernel(shared.settings_303);
+}
+
+void set_output_step_generic(u8 generic) {
+    output_step_generic = generic;
+    select_output_step();
+}
+#endif
+
+void select_output_step() {
+#ifdef OUTPUT_STEP_GENERIC
+    if (output_step_generic) {
+        output_step = output_step_any;
+        return;
+    }
+#endif
+    output_step = output_step_kernels[shared.settings_303 & (SETTING_303_COMBINATIONS - 1)];
+}
+
+void output_step_off() {
+    if (!gate_held && !gate_timed) set_main_gate(0);
+    
+    // other voices always follow the clock
+    for (u8 v = 1; v < e_get_voice_count(&voices); v++)
+        if (e_get_gate(voices.pattern[v], e_get_voice_step(&voices, v)) != GATE_TIE) set_gate(v, 0);
+}
+
+// runs after the step has ended, well ahead of the next clock edge
+void prepare_next_step() {
+    for (u8 v = 0; v < e_get_voice_count(&voices); v++)
+        prepare_step(v, e_get_next_step(&voices, v, e_get_voice_step(&voices, v)));
+}
+
+void prepare_step(u8 voice, u8 step) {
+    e_prepare_step(&voices, voice, step, &lookahead[voice]);
+    lookahead_dac[voice] = pitch_to_dac(lookahead[voice].s.pitch, lookahead[voice].s.transpose);
+}
+
+// the step a voice is on, only read here if the lookahead went stale
+engine_lookahead_t *get_step(u8 voice) {
+    if (!e_is_prepared(&voices, voice, &lookahead[voice]))
+        prepare_step(voice, e_get_voice_step(&voices, voice));
+    return &lookahead[voice];
+}
+
+void measure_clock() {
+    tempo_edge(&tempo, get_global_time());
+    clock_period = tempo_get_period(&tempo);
+}
+
+void schedule(u16 ms, u8 type) {
+    if (!wheel_count(&wheel)) add_timed_event(TIMER_WHEEL, 1, 1);
+    wheel_schedule(&wheel, ms, type, 0);
+}
+
+// only needs to run when the playing pattern, a slot the voices play or the
+// voice count changes
+void assign_voices() {
+    for (u8 v = 0; v < e_get_voice_count(&voices); v++)
+        e_set_voice_pattern(&voices, v, patterns[(playing_index + v) % PATTERN_COUNT]);
+}
+
+// gates that change owner are closed, they get set again on the next step
+void set_voice_count(u8 count) {
+    commit_edits();
+    shared.voice_count = count;
+    e_set_voice_count(&voices, count);
+    assign_voices();
+    for (u8 v = 1; v < MAX_VOICES; v++) set_gate(v, 0);
+}
+
+// fills the edited pattern, a playing pattern changes on the next step
+void generate(u8 new_seed) {
+    generator_t g;
+    u32 scale = generator_scales[shared.generator_scale];
+    
+    if (new_seed) shared.generator_seed = generator_next_seed(shared.generator_seed, get_global_time());
+    
+    g.seed = shared.generator_seed;
+    g.length = MAX_PATTERN_LENGTH;
+    g.density = shared.generator_density * GENERATOR_ALWAYS / MAX_GENERATOR_LEVEL;
+    g.accent = shared.generator_accent * GENERATOR_ALWAYS / MAX_GENERATOR_LEVEL;
+    g.slide = shared.generator_slide * GENERATOR_ALWAYS / MAX_GENERATOR_LEVEL;
+    g.octave = shared.generator_octave * GENERATOR_ALWAYS / MAX_GENERATOR_LEVEL;
+    g.scale = scale | scale << 12;
+    
+    edit_pattern();
+    replaced = *pattern;
+    record_index = NO_PATTERN;
+    history_record(&history, edited_index, ++replaced_id, HISTORY_PATTERN, 0, 1);
+    generate_pattern(pattern, &g);
+    refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
+}
+
+// rebuilds the dac table for the current scale settings, not for the clock
+// path. values prepared with the old table are dropped.
+void update_pitch_table() {
+    scale_build_table(&pitch_table, shared.scale, shared.root, shared.tuning, TRANSPOSE_OUTPUT + shared.transpose);
+    for (u8 v = 0; v < MAX_VOICES; v++) lookahead[v].pattern = 0;
+}
+
+u16 pitch_to_dac(s8 pitch, u8 transpose) {
+    if (pitch < 0) pitch = 0;
+    else if (pitch > MAX_PITCH_VALUE) pitch = MAX_PITCH_VALUE;
+    return pitch_table.dac[transpose < TRANSPOSE_COUNT ? transpose : TRANSPOSE_OFF][pitch];
+}
+
+// the note the next gate on sends
+void set_midi_note(s8 pitch, u8 transpose, u8 accent) {
+    if (pitch < 0) pitch = 0;
+    else if (pitch > MAX_PITCH_VALUE) pitch = MAX_PITCH_VALUE;
+    midi_next_note = pitch_table.note[transpose < TRANSPOSE_COUNT ? transpose : TRANSPOSE_OFF][pitch];
+    midi_next_velocity = accent ? MIDI_VELOCITY_ACCENT : MIDI_VELOCITY;
+}
+
+// gate 0 and its midi note. a gate that is already open for another note,
+// after a slide or a tie, starts the new note before ending the old one so
+// it plays legato.
+void set_main_gate(u8 on) {
+    set_gate(0, on);
+    
+    if (on) {
+        if (midi_note == midi_next_note) return;
+        midi_send(&midi_out, MIDI_NOTE_ON | MIDI_CHANNEL, midi_next_note, midi_next_velocity);
+        if (midi_note >= 0) midi_send(&midi_out, MIDI_NOTE_OFF | MIDI_CHANNEL, midi_note, 0);
+        midi_note = midi_next_note;
+    } else if (midi_note >= 0) {
+        midi_send(&midi_out, MIDI_NOTE_OFF | MIDI_CHANNEL, midi_note, 0);
+        midi_note = -1;
+    }
+}
+
+// glides from the current cv to the new value, the timer only runs while
+// there is somewhere to glide to
+void output_pitch(u16 value) {
+    u8 sliding = slide.active;
+    
+    slide_start(&slide, cv_value, value, slide_times[shared.slide_time] / SLIDE_UPDATE_INTERVAL);
+    if (slide.active) {
+        if (!sliding) add_timed_event(TIMER_SLIDE, SLIDE_UPDATE_INTERVAL, 1);
+        return;
+    }
+    
+    if (sliding) stop_timed_event(TIMER_SLIDE);
+    cv_value = value;
+    set_cv(0, value);
+}
+
+// jumps to the new value, cancelling any slide in progress
+void set_pitch(u16 value) {
+    if (slide.active) {
+        slide_stop(&slide);
+        stop_timed_event(TIMER_SLIDE);
+    }
+    cv_value = value;
+    set_cv(0, value);
+}
+
+void sub_step(u8 type, u8 data) {
+    switch (type) {
+        case SUB_STEP_OUTPUT:
+            output_step();
+            break;
+        case SUB_STEP_OFF:
+            output_step_off();
+            prepare_next_step();
+            break;
+        case SUB_GATE_ON:
+            set_main_gate(1);
+            break;
+        case SUB_GATE_OFF:
+            set_main_gate(0);
+            break;
+        default:
+            break;
+    }
+}
+
+void init_patterns() {
+    for (u8 i = 0; i < PATTERN_COUNT; i++) {
+        patterns[i] = &pattern_storage[i];
+        e_init(patterns[i]);
+    }
+    for (u8 v = 0; v < MAX_VOICES; v++) {
+        spares[v] = &pattern_storage[PATTERN_COUNT + v];
+        e_init(spares[v]);
+    }
+    
+    playing_index = edited_index = 0;
+    queued_index = NO_PATTERN;
+    edit_pending = 0;
+    playing = pattern = patterns[0];
+}
+
+void select_pattern(u8 index) {
+    edited_index = index;
+    update_edited_pattern();
+    
+    if (seq_on && index != playing_index) {
+        queued_index = index;
+        return;
+    }
+    
+    // nothing is playing or the playing pattern was reselected
+    queued_index = NO_PATTERN;
+    if (index == playing_index) return;
+    
+    commit_edits();
+    patterns[index]->ps = playing->ps;
+    playing_index = index;
+    playing = pattern = patterns[index];
+    assign_voices();
+}
+
+// the voice playing slot index, NO_VOICE if the sequencer is stopped or
+// no voice plays it
+u8 get_voice(u8 index) {
+    u8 v = (index + PATTERN_COUNT - playing_index) % PATTERN_COUNT;
+    return seq_on && v < e_get_voice_count(&voices) ? v : NO_VOICE;
+}
+
+// slot index with the edits that haven't been swapped in yet
+engine_pattern_t *pending_pattern(u8 index) {
+    u8 v = get_voice(index);
+    return v != NO_VOICE && (edit_pending & (1 << v)) ? spares[v] : patterns[index];
+}
+
+void update_edited_pattern() {
+    pattern = pending_pattern(edited_index);
+}
+
+// called before every edit, makes sure edits never touch a playing pattern
+void edit_pattern() {
+    editable_pattern(edited_index);
+}
+
+// edits to a pattern a voice plays go to the voice's copy in spares
+engine_pattern_t *editable_pattern(u8 index) {
+    mark_pattern_dirty(index);
+    u8 v = get_voice(index);
+    if (v == NO_VOICE) return patterns[index];
+    
+    if (!(edit_pending & (1 << v))) {
+        *spares[v] = *patterns[index];
+        edit_pending |= 1 << v;
+        update_edited_pattern();
+    }
+    return spares[v];
+}
+
+// the copies carry the step over, which keeps the voices where they are
+void commit_edits() {
+    if (!edit_pending) return;
+    
+    for (u8 v = 0; v < MAX_VOICES; v++) {
+        if (!(edit_pending & (1 << v))) continue;
+        u8 index = (playing_index + v) % PATTERN_COUNT;
+        engine_pattern_t *edited = spares[v];
+        spares[v] = patterns[index];
+        edited->ps = patterns[index]->ps;
+        patterns[index] = edited;
+    }
+    edit_pending = 0;
+    
+    playing = patterns[playing_index];
+    assign_voices();
+    update_edited_pattern();
+}
+
+// ----------------------------------------------------------------------------
+// edit history
+
+// edits a step of the pattern shown on the grid and records it for undo
+void edit_step(u8 step, u8 field, s8 value) {
+    edit_pattern_step(edited_index, step, field, value);
+}
+
+void edit_pattern_step(u8 index, u8 step, u8 field, s8 value) {
+    if (step >= MAX_PATTERN_LENGTH) return;
+    u8 menu_changed = !history.undo_count || history.redo_count;
+    
+    engine_pattern_t *ep = editable_pattern(index);
+    history_record(&history, index, step, field, get_field(ep, step, field), value);
+    set_field(ep, step, field, value);
+    if (menu_changed) refresh(DIRTY_TRACKER_MENU);
+}
+
+s8 get_field(engine_pattern_t *ep, u8 step, u8 field) {
+    switch (field) {
+        case HISTORY_PITCH: return e_get_pitch(ep, step);
+        case HISTORY_GATE: return e_get_gate(ep, step);
+        case HISTORY_ACCENT: return e_get_accent(ep, step);
+        case HISTORY_SLIDE: return e_get_slide(ep, step);
+        case HISTORY_TRANSPOSE: return e_get_transpose(ep, step);
+        case HISTORY_RESET: return e_get_reset(ep, step);
+        case HISTORY_RATCHET: return e_get_ratchet(ep, step);
+        default: return 0;
+    }
+}
+
+void set_field(engine_pattern_t *ep, u8 step, u8 field, s8 value) {
+    switch (field) {
+        case HISTORY_PITCH: e_set_pitch(ep, step, value); break;
+        case HISTORY_GATE: e_set_gate(ep, step, value); break;
+        case HISTORY_ACCENT: e_set_accent(ep, step, value); break;
+        case HISTORY_SLIDE: e_set_slide(ep, step, value); break;
+        case HISTORY_TRANSPOSE: e_set_transpose(ep, step, value); break;
+        case HISTORY_RESET: e_set_reset(ep, step, value); break;
+        case HISTORY_RATCHET: e_set_ratchet(ep, step, value); break;
+        default: break;
+    }
+}
+
+void apply_edit(history_edit_t *e, s8 value) {
+    u8 field = e->field & HISTORY_FIELD_MASK;
+    
+    if (field == HISTORY_PRESET) {
+        select_preset(value);
+    } else if (field == HISTORY_PATTERN) {
+        swap_replaced(e->pattern);
+    } else {
+        set_field(editable_pattern(e->pattern), e->step, field, value);
+    }
+}
+
+// the playback state stays with the slot
+void swap_replaced(u8 index) {
+    engine_pattern_t *ep = editable_pattern(index);
+    engine_pattern_t swapped = *ep;
+    
+    ep->p = replaced.p;
+    ep->pi = replaced.pi;
+    ep->revision++;
+    replaced = swapped;
+    record_index = NO_PATTERN;
+}
+
+// reverts the last edit along with the edits joined to it. a pattern
+// generated before the last one can't be brought back, and neither can
+// anything older than it.
+void undo() {
+    history_edit_t *e;
+    
+    while ((e = history_undo(&history))) {
+        if ((e->field & HISTORY_FIELD_MASK) == HISTORY_PATTERN && e->step != replaced_id) {
+            history_redo(&history);
+            history_forget(&history);
+            break;
+        }
+        apply_edit(e, e->from);
+        if (!(e->field & HISTORY_JOINED)) break;
+    }
+    refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
+}
+
+void redo() {
+    history_edit_t *e;
+    
+    while ((e = history_redo(&history))) {
+        apply_edit(e, e->to);
+        if (!history_redo_joined(&history)) break;
+    }
+    refresh(DIRTY_TRACKER_MENU | DIRTY_TRACKER);
+}
+
+// ----------------------------------------------------------------------------
+// presets
+
+// switches presets from the grid or the history, the timer writes the new
+// index. only one preset left with edits can wait to be written, while an
+// earlier one still waits the switch waits for the timer too.
+void select_preset(u8 index) {
+    switch_index = NO_PRESET;
+    if ((autosave_dirty || autosave_store) && left_store && left_index != selected_preset) {
+        switch_index = index;
+        add_timed_event(TIMER_AUTOSAVE, AUTOSAVE_INTERVAL, 0);
+        return;
+    }
+    
+    load_preset(index);
+    index_store = 1;
+    autosave_later();
+}
+
+void load_preset(u8 index) {
+    u16 length = 0, remaining;
+    u8 count;
+    engine_pattern_t *ep;
+    
+    // the preset being left is encoded now and written by the timer, see
+    // select_preset
+    if (autosave_dirty || autosave_store) {
+        for (u8 i = 0; i < PATTERN_COUNT; i++)
+            if (autosave_dirty & (1 << i)) encode_pattern(i);
+        autosave_dirty = autosave_store = 0;
+        
+        memcpy(&left_meta, &meta, sizeof(preset_meta_t));
+        memcpy(&left_preset, &preset, sizeof(preset_data_t));
+        left_index = selected_preset;
+        left_store = 1;
+        add_timed_event(TIMER_AUTOSAVE, AUTOSAVE_INTERVAL, 0);
+    }
+    
+    // flash is behind for a preset that hasn't been written yet
+    if (left_store && left_index == index) {
+        memcpy(&meta, &left_meta, sizeof(preset_meta_t));
+        memcpy(&preset, &left_preset, sizeof(preset_data_t));
+    } else {
+        load_preset_from_flash(index, &preset);
+        load_preset_meta_from_flash(index, &meta);
+    }
+    
+    // the patterns the voices play are decoded into their spares and
+    // swapped in on the next step
+    edit_pending = 0;
+    for (u8 v = 0; seq_on && v < e_get_voice_count(&voices); v++) edit_pending |= 1 << v;
+    
+    for (u8 i = 0; i < PATTERN_COUNT; i++) {
+        ep = pending_pattern(i);
+        remaining = sizeof(preset.patterns) - length;
+        count = e_decode_pattern(ep, preset.patterns + length,
+            remaining < ENCODED_PATTERN_MAX_SIZE ? remaining : ENCODED_PATTERN_MAX_SIZE);
+        if (!count) {
+            // cleared patterns get encoded again with the next save
+            for (; i < PATTERN_COUNT; i++) {
+                e_init(pending_pattern(i));
+                encoded_length[i] = 0;
+                autosave_dirty |= 1 << i;
+            }
+            break;
+        }
+        encoded_length[i] = count;
+        length += count;
+    }
+    
+    update_edited_pattern();
+    selected_preset = index;
+    
+    refresh(DIRTY_MENU | DIRTY_TRACKER_MENU | DIRTY_TRACKER);
+}
+
+// saves everything without waiting for the quiet period
+void save_preset() {
+    autosave_dirty = (1 << PATTERN_COUNT) - 1;
+    autosave();
+}
+
+// encodes a pattern into its place in the preset image, the patterns after
+// it move if its size changed
+void encode_pattern(u8 index) {
+    u8 data[ENCODED_PATTERN_MAX_SIZE];
+    u16 offset = 0, end;
+    
+    for (u8 i = 0; i < index; i++) offset += encoded_length[i];
+    end = offset;
+    for (u8 i = index; i < PATTERN_COUNT; i++) end += encoded_length[i];
+    
+    u8 length = e_encode_pattern(pending_pattern(index), data);
+    u16 old_end = offset + encoded_length[index];
+    memmove(preset.patterns + offset + length, preset.patterns + old_end, end - old_end);
+    memcpy(preset.patterns + offset, data, length);
+    encoded_length[index] = length;
+}
+
+void mark_pattern_dirty(u8 index) {
+    autosave_dirty |= 1 << index;
+    autosave_later();
+}
+
+// every edit starts the quiet period over, a preset left waiting isn't held up
+void autosave_later() {
+    add_timed_event(TIMER_AUTOSAVE, left_store ? AUTOSAVE_INTERVAL : AUTOSAVE_QUIET_TIME, 0);
+}
+
+void autosave() {
+    if (switch_index != NO_PRESET && !left_store) select_preset(switch_index);
+    
+    u16 wait = autosave_wait();
+    if (wait) add_timed_event(TIMER_AUTOSAVE, wait, 0);
+    else if (autosave_step()) add_timed_event(TIMER_AUTOSAVE, AUTOSAVE_INTERVAL, 0);
+}
+
+// does one piece of the save, returns 0 once there's nothing left to do
+u8 autosave_step() {
+    if (left_store) {
+        left_store = 0;
+        store_preset_to_flash(left_index, &left_meta, &left_preset);
+        return 1;
+    }
+    
+    if (index_store) {
+        index_store = 0;
+        store_preset_index(selected_preset);
+        return 1;
+    }
+    
+    for (u8 i = 0; i < PATTERN_COUNT; i++) {
+        if (!(autosave_dirty & (1 << i))) continue;
+        autosave_dirty &= ~(1 << i);
+        encode_pattern(i);
+        autosave_store = 1;
+        return 1;
+    }
+    
+    if (autosave_store) {
+        autosave_store = 0;
+        store_preset_to_flash(selected_preset, &meta, &preset);
+        return 1;
+    }
+    
+    if (memcmp(&saved_shared, &shared, sizeof(shared_data_t))) {
+        memcpy(&saved_shared, &shared, sizeof(shared_data_t));
+        store_shared_data_to_flash(&shared);
+        return 1;
+    }
+    
+    return 0;
+}
+
+// 0 if a flash write can start now, otherwise how long to wait. sub-steps
+// and slides can't be held up at all. with a clock running the write has
+// to finish before the next edge or wait until that edge has passed, a
+// fast clock only leaves the first half of each step.
+u16 autosave_wait() {
+    if (wheel_count(&wheel) || slide.active) return AUTOSAVE_INTERVAL;
+    if (!seq_on || !clock_period) return 0;
+    
+    // a late edge could come any moment, the tracker stops the clock if it
+    // doesn't come at all
+    u64 now = get_global_time();
+    if (now >= tempo.next_edge) return AUTOSAVE_INTERVAL;
+    
+    u16 margin = clock_period >> 1 < AUTOSAVE_MARGIN ? clock_period >> 1 : AUTOSAVE_MARGIN;
+    u16 left = tempo.next_edge - now;
+    return left > margin ? 0 : left + 1;
+}
+
+// ----------------------------------------------------------------------------
+// timers
+
+// the blink timer only runs while recording is armed or on, everything
+// recorded in one take is undone at once
+void set_recording_mode(u8 mode) {
+    if (mode == recording_mode) return;
+    
+    if (mode == RECORDING_OFF)
+        stop_timed_event(TIMER_RECORDING);
+    else if (recording_mode == RECORDING_OFF)
+        add_timed_event(TIMER_RECORDING, RECORDING_BLINK_INTERVAL, 1);
+    
+    if (mode == RECORDING_ON) {
+        history_start_group(&history);
+        record_index = NO_PATTERN;
+    } else if (recording_mode == RECORDING_ON) {
+        history_end_group(&history);
+        record_start = NO_STEP;
+        record_accent = 0;
+    }
+    
+    recording_mode = mode;
+}
+
+// writes captured notes into the playing pattern, returns 1 if anything
+// was written. a press or a release ends the note held before it.
+u8 record_notes() {
+    recorder_note_t n;
+    u8 step, recorded = 0;
+    u16 latency = shared.record_latency * RECORD_LATENCY_UNIT;
+    
+    while (recorder_pop(&recorder, &n)) {
+        step = record_step(recorder_quantize(n.time, record_clock_time, clock_period, latency));
+        
+        if (record_start != NO_STEP) {
+            record_ties(step);
+            record_start = NO_STEP;
+        }
+        if (n.note == RECORDER_RELEASE || recording_mode != RECORDING_ON) continue;
+        
+        record_edit(step, HISTORY_PITCH, n.note);
+        record_edit(step, HISTORY_GATE, GATE_ON);
+        record_edit(step, HISTORY_ACCENT, n.accent);
+        record_start = step;
+        record_pitch = n.note;
+        recorded = 1;
+    }
+    
+    return recorded;
+}
+
+// the step offset steps after the one the last clock edge played,
+// following resets and the voice length. a note early for that step
+// belongs to the step that played before it.
+u8 record_step(s8 offset) {
+    u8 step = record_clock_step;
+    
+    if (offset < 0) return record_prev_step == NO_STEP ? step : record_prev_step;
+    while (offset--) step = e_get_next_step(&voices, 0, step);
+    return step;
+}
+
+// ties the held note into every step played before end. nothing is tied
+// if end can't be reached from the start anymore.
+void record_ties(u8 end) {
+    u8 step = record_start;
+    u16 count = 0;
+    
+    if (end == record_start) return;
+    do {
+        step = e_get_next_step(&voices, 0, step);
+        if (++count > MAX_PATTERN_LENGTH) return;
+    } while (step != end);
+    
+    step = record_start;
+    while ((step = e_get_next_step(&voices, 0, step)) != end) {
+        record_edit(step, HISTORY_PITCH, record_pitch);
+        record_edit(step, HISTORY_GATE, GATE_TIE);
+        record_edit(step, HISTORY_ACCENT, 0);
+    }
+}
+
+// the first write of a take keeps the pattern it replaces the way
+// generate() does, so the whole take is a single edit in the history
+void record_edit(u8 step, u8 field, s8 value) {
+    if (record_index != playing_index) {
+        u8 menu_changed = !history.undo_count || history.redo_count;
+        
+        replaced = *pending_pattern(playing_index);
+        record_index = playing_index;
+        history_record(&history, playing_index, ++replaced_id, HISTORY_PATTERN, 0, 1);
+        if (menu_changed) refresh(DIRTY_TRACKER_MENU);
+    }
+    set_field(editable_pattern(playing_index), step, field, value);
+}
+
+void set_render_interval(u16 ms) {
+    if (ms < MIN_RENDER_INTERVAL) ms = MIN_RENDER_INTERVAL;
+    else if (ms > MAX_RENDER_INTERVAL) ms = MAX_RENDER_INTERVAL;
+    if (ms == render_interval) return;
+    render_interval = ms;
+    add_timed_event(TIMER_RENDER, render_interval, 1);
+}
+
+// ----------------------------------------------------------------------------
+// grid framebuffer
+
+void set_led(u8 x, u8 y, u8 level) {
+    grid_frame[y][x] = level;
+}
+
+// marks regions for redrawing, the grid refresh itself is requested by
+// the render timer
+void refresh(u8 regions) {
+    if (grid_refresh_pending) window_count(&diag_coalesced);
+    grid_dirty |= regions;
+    grid_refresh_pending = 1;
+    
+    // the pitch ring shows the same pattern as the tracker
+    if (regions & DIRTY_TRACKER) refresh_arc_rings(1 << ARC_RING_PITCH);
+}
+
+void invalidate_grid() {
+    // forces every LED to be sent on the next render
+    memset(grid_sent, LED_UNKNOWN, sizeof(grid_sent));
+}
+
+// ----------------------------------------------------------------------------
+// arc
+
+// turns the encoder movement since the last frame into value changes, what
+// isn't a full change yet carries over to the next frame
+void apply_arc_deltas() {
+    s16 change, value;
+    arc_delta_pending = 0;
+    
+    for (u8 r = 0; r < ARC_RING_COUNT; r++) {
+        change = arc_delta[r] / ARC_SENSITIVITY;
+        if (!change) continue;
+        arc_delta[r] -= change * ARC_SENSITIVITY;
+        
+        if (r == ARC_RING_STEP) {
+            arc_step = (arc_step + MAX_PATTERN_LENGTH + change % MAX_PATTERN_LENGTH) % MAX_PATTERN_LENGTH;
+            refresh_arc_rings(1 << ARC_RING_STEP | 1 << ARC_RING_PITCH);
+        } else if (r == ARC_RING_PITCH) {
+            value = e_get_pitch(pattern, arc_step) + change;
+            if (value < 0) value = 0;
+            else if (value > MAX_PITCH_VALUE) value = MAX_PITCH_VALUE;
+            
+            // anything else recorded since ends the turn
+            if (history.head == arc_turn_head && get_global_time() - arc_turn_time < ARC_TURN_GAP &&
+                history_amend(&history, edited_index, arc_step, HISTORY_PITCH, value))
+                set_field(editable_pattern(edited_index), arc_step, HISTORY_PITCH, value);
+            else
+                edit_step(arc_step, HISTORY_PITCH, value);
+            arc_turn_head = history.head;
+            arc_turn_time = get_global_time();
+            refresh(DIRTY_TRACKER);
+        } else if (r == ARC_RING_TRANSPOSE) {
+            value = shared.transpose + change;
+            if (value < -MAX_TRANSPOSE) value = -MAX_TRANSPOSE;
+            else if (value > MAX_TRANSPOSE) value = MAX_TRANSPOSE;
+            if (value == shared.transpose) continue;
+            shared.transpose = value;
+            update_pitch_table();
+            refresh_arc_rings(1 << ARC_RING_TRANSPOSE);
+        }
+    }
+}
+
+// each step gets the same share of the ring, with a tick every 8 steps
+void render_arc_step() {
+    u8 width = ARC_LEDS / MAX_PATTERN_LENGTH;
+    u8 current_step = e_get_voice_step(&voices, 0);
+    
+    for (u8 step = 0; step < MAX_PATTERN_LENGTH; step += 8) arc_frame[ARC_RING_STEP][step * width] = LED_ARC_TICK;
+    for (u8 i = 0; i < width; i++) {
+        arc_frame[ARC_RING_STEP][current_step * width + i] = LED_ARC_PLAYING;
+        arc_frame[ARC_RING_STEP][arc_step * width + i] = LED_ARC_SELECTED;
+    }
+}
+
+// the selected step's pitch as a level, dimmer on a rest
+void render_arc_pitch() {
+    u8 level = e_get_gate(pattern, arc_step) == GATE_REST ? LED_ARC_REST : LED_ARC_VALUE;
+    u8 count = (e_get_pitch(pattern, arc_step) + 1) * ARC_LEDS / (MAX_PITCH_VALUE + 1);
+    
+    for (u8 led = 0; led < count; led++) arc_frame[ARC_RING_PITCH][led] = level;
+}
+
+// 2 LEDs per semitone either way from the top
+void render_arc_transpose() {
+    s8 transpose = shared.transpose;
+    
+    for (u8 i = 1; i <= (transpose < 0 ? -transpose : transpose) * 2; i++)
+        arc_frame[ARC_RING_TRANSPOSE][transpose > 0 ? i : ARC_LEDS - i] = LED_ARC_VALUE;
+    arc_frame[ARC_RING_TRANSPOSE][0] = LED_ARC_CENTER;
+}
+
+// rings are redrawn on the next frame
+void refresh_arc_rings(u8 rings) {
+    arc_dirty |= rings;
+    arc_refresh_pending = 1;
+}
+
+void invalidate_arc() {
+    memset(arc_sent, LED_UNKNOWN, sizeof(arc_sent));
 }
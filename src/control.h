@@ -4,7 +4,11 @@
 
 #pragma once
 #include "types.h"
+#include "config.h"
 #include "engine.h"
+#include "profile.h"
+#include "evlog.h"
+#include "midi.h"
 
 
 // ----------------------------------------------------------------------------
@@ -14,19 +18,55 @@
 // ----------------------------------------------------------------------------
 // shared types
 
+#define PATTERN_COUNT 8
+
 typedef struct {
 } preset_meta_t;
 
 typedef struct {
+    u8 gate_length;
+    u8 swing;
+    u8 slide_time;
+    u8 voice_count;
+    u8 generator_density;
+    u8 generator_accent;
+    u8 generator_slide;
+    u8 generator_octave;
+    u8 generator_scale;
+    u32 generator_seed;
+    u8 scale;
+    u8 root;
+    u8 tuning;
+    u8 record_latency;
+    u8 midi_divider;
+    s8 transpose;
+    u8 settings_303;
 } shared_data_t;
 
 typedef struct {
+    u8 patterns[PATTERN_COUNT * ENCODED_PATTERN_MAX_SIZE];
 } preset_data_t;
 
 
 // ----------------------------------------------------------------------------
 // firmware settings/variables main.c needs to know
 
+// main.c writes received midi bytes to midi_in and calls process_midi, and
+// sends whatever control.c leaves in midi_out. without that, MIDI_NOTE
+// events still play notes but midi clock isn't followed.
+extern midi_ring_t midi_in, midi_out;
+
+// midi notes from LOWEST_NOTE up play pitches 0 to MAX_PITCH_VALUE, pitch 0
+// is the same note on cv 0
+#define LOWEST_NOTE 36
+
+// timed events control.c uses, other timers in main.c need other indexes
+#define TIMER_RECORDING 0
+#define TIMER_RENDER    1
+#define TIMER_WHEEL     2
+#define TIMER_SLIDE     3
+#define TIMER_AUTOSAVE  4
+
 
 // ----------------------------------------------------------------------------
 // functions control.c needs to implement (will be called from main.c)
@@ -34,9 +74,32 @@ typedef struct {
 void init_presets(void);
 void init_control(void);
 void process_event(u8 event, u8 *data, u8 length);
+void process_midi(void);
 void render_grid(void);
 void render_arc(void);
 
+// grid and arc refreshes are sent at most once per interval, 20 ms unless
+// main.c picks another one between 5 and 100 ms, e.g. a longer one for a
+// grid behind a slow hub
+void set_render_interval(u16 ms);
+
+
+// ----------------------------------------------------------------------------
+// diagnostics
+
+latency_t *get_clock_latency(void);
+latency_t *get_clock_off_latency(void);
+
+#ifdef EVENT_LOG
+evlog_t *get_event_log(void);
+#endif
+
+#ifdef OUTPUT_STEP_GENERIC
+// 1 runs the kernel with shared.settings_303 read at run time instead of
+// the specialised ones, to check them against it
+void set_output_step_generic(u8 generic);
+#endif
+
 
 // ----------------------------------------------------------------------------
 // functions engine needs to call
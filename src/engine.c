@@ -5,25 +5,164 @@
 #include "engine.h"
 #include "control.h"
 
+static void set_bit(step_mask_t *mask, u8 step, u8 on) {
+    if (on) *mask |= STEP_BIT(step); else *mask &= ~STEP_BIT(step);
+}
+
+static u8 get_bit(step_mask_t mask, u8 step) {
+    return (mask >> step) & 1;
+}
+
+static void add_pitch(engine_pattern_t *ep, s8 pitch) {
+    if (pitch < 0 || pitch > MAX_PITCH_VALUE) return;
+    if (!ep->pi.count[pitch]++) ep->pi.used |= 1UL << pitch;
+}
+
+static void remove_pitch(engine_pattern_t *ep, s8 pitch) {
+    if (pitch < 0 || pitch > MAX_PITCH_VALUE || !ep->pi.count[pitch]) return;
+    if (!--ep->pi.count[pitch]) ep->pi.used &= ~(1UL << pitch);
+}
+
+#define TOKEN_BLANK_RUN       0x80
+#define TOKEN_BLANK_RUN_MAX   0xFF
+#define TOKEN_GATE_MASK       0x03
+#define TOKEN_ACCENT          0x04
+#define TOKEN_SLIDE           0x08
+#define TOKEN_TRANSPOSE_MASK  0x30
+#define TOKEN_TRANSPOSE_SHIFT 4
+#define TOKEN_RESET           0x40
+#define TOKEN_PITCH_MASK      0x1F
+#define TOKEN_RATCHET_SHIFT   5
+
+// ----------------------------------------------------------------------------
+
 void e_init(engine_pattern_t *ep) {
-    for (int i = 0; i < MAX_PATTERN_LENGTH; i++) {
-        ep->p.steps[i].pitch = 0;
-        ep->p.steps[i].gate = GATE_REST;
-        ep->p.steps[i].accent = 0;
-        ep->p.steps[i].slide = 0;
-        ep->p.steps[i].transpose = TRANSPOSE_OFF;
-    }
+    for (int i = 0; i < MAX_PATTERN_LENGTH; i++) ep->p.pitch[i] = 0;
+    
+    ep->p.gate_on = 0;
+    ep->p.gate_tie = 0;
+    ep->p.accent = 0;
+    ep->p.slide = 0;
+    ep->p.transpose_up = 0;
+    ep->p.transpose_down = 0;
+    ep->p.reset = 0;
+    ep->p.ratchet_lo = 0;
+    ep->p.ratchet_hi = 0;
+    
+    for (int i = 0; i <= MAX_PITCH_VALUE; i++) ep->pi.count[i] = 0;
+    ep->pi.used = 0;
     
     ep->ps.current_step = 0;
+    ep->revision++;
 }
 
 void e_reset(engine_pattern_t *ep) {
     ep->ps.current_step = 0;
 }
 
-void e_step(engine_pattern_t *ep) {
-    if (ep->p.steps[ep->ps.current_step].is_reset || ++ep->ps.current_step >= MAX_PATTERN_LENGTH)
+// returns 1 when the pattern wraps to the first step
+u8 e_step(engine_pattern_t *ep) {
+    if (get_bit(ep->p.reset, ep->ps.current_step) || ++ep->ps.current_step >= MAX_PATTERN_LENGTH) {
         ep->ps.current_step = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// voices
+
+void e_init_voices(engine_voices_t *ev, u8 count) {
+    for (u8 i = 0; i < MAX_VOICES; i++) {
+        ev->pattern[i] = 0;
+        ev->step[i] = 0;
+        ev->length[i] = MAX_PATTERN_LENGTH;
+    }
+    ev->count = 1;
+    ev->revision++;
+    e_set_voice_count(ev, count);
+}
+
+// advances all voices, returns a mask with a bit set for each voice that
+// wrapped to the first step. every voice needs a pattern.
+u8 e_step_all(engine_voices_t *ev) {
+    u8 wrapped = 0;
+    
+    for (u8 i = 0; i < ev->count; i++) {
+        u8 step = e_get_next_step(ev, i, ev->step[i]);
+        ev->step[i] = step;
+        ev->pattern[i]->ps.current_step = step;
+        wrapped |= !step << i;
+    }
+    
+    return wrapped;
+}
+
+u8 e_get_voice_count(engine_voices_t *ev) {
+    return ev->count;
+}
+
+void e_set_voice_count(engine_voices_t *ev, u8 count) {
+    if (!count || count > MAX_VOICES) return;
+    ev->count = count;
+    ev->revision++;
+}
+
+// a voice given a different pattern continues from the current step of
+// that pattern, giving it the same pattern again changes nothing
+void e_set_voice_pattern(engine_voices_t *ev, u8 voice, engine_pattern_t *ep) {
+    if (voice >= MAX_VOICES || ev->pattern[voice] == ep) return;
+    ev->pattern[voice] = ep;
+    ev->step[voice] = ep->ps.current_step;
+    ev->revision++;
+}
+
+u8 e_get_voice_step(engine_voices_t *ev, u8 voice) {
+    return ev->step[voice];
+}
+
+void e_set_voice_step(engine_voices_t *ev, u8 voice, u8 step) {
+    if (voice >= MAX_VOICES || step >= MAX_PATTERN_LENGTH) return;
+    ev->step[voice] = step;
+    if (ev->pattern[voice]) ev->pattern[voice]->ps.current_step = step;
+}
+
+u8 e_get_voice_length(engine_voices_t *ev, u8 voice) {
+    return ev->length[voice];
+}
+
+void e_set_voice_length(engine_voices_t *ev, u8 voice, u8 length) {
+    if (voice >= MAX_VOICES || !length || length > MAX_PATTERN_LENGTH) return;
+    ev->length[voice] = length;
+    ev->revision++;
+}
+
+// the step e_step_all moves the voice to from step
+u8 e_get_next_step(engine_voices_t *ev, u8 voice, u8 step) {
+    return get_bit(ev->pattern[voice]->p.reset, step) || step + 1 >= ev->length[voice] ? 0 : step + 1;
+}
+
+// ----------------------------------------------------------------------------
+// lookahead
+
+void e_prepare_step(engine_voices_t *ev, u8 voice, u8 step, engine_lookahead_t *la) {
+    engine_pattern_t *ep = ev->pattern[voice];
+    u8 next = e_get_next_step(ev, voice, step);
+    
+    la->pattern = ep;
+    la->revision = ep->revision;
+    la->voices_revision = ev->revision;
+    la->step = step;
+    e_get_step(ep, step, &la->s);
+    la->next_gate = e_get_gate(ep, next);
+    la->next_slide = e_get_slide(ep, next);
+}
+
+// true if la still holds the step the voice is on
+u8 e_is_prepared(engine_voices_t *ev, u8 voice, engine_lookahead_t *la) {
+    engine_pattern_t *ep = ev->pattern[voice];
+    return la->pattern == ep && la->step == ev->step[voice] &&
+        la->revision == ep->revision && la->voices_revision == ev->revision;
 }
 
 // ----------------------------------------------------------------------------
@@ -40,99 +179,253 @@ void e_set_current_step(engine_pattern_t *ep, u8 step) {
 // ----------------------------------------------------------------------------
 
 s8 e_get_pitch(engine_pattern_t *ep, u8 step) {
-    return ep->p.steps[step].pitch;
+    return ep->p.pitch[step];
 }
 
 s8 e_get_pitch_transposed(engine_pattern_t *ep, u8 step) {
     s8 pitch = e_get_pitch(ep, step);
-    if (ep->p.steps[step].transpose == TRANSPOSE_UP) pitch += 12;
-    else if (ep->p.steps[step].transpose == TRANSPOSE_DOWN) pitch -= 12;
+    if (get_bit(ep->p.transpose_up, step)) pitch += 12;
+    else if (get_bit(ep->p.transpose_down, step)) pitch -= 12;
     return pitch;
 }
 
 s8 e_get_current_pitch(engine_pattern_t *ep) {
-    return ep->p.steps[ep->ps.current_step].pitch;
+    return ep->p.pitch[ep->ps.current_step];
 }
 
 s8 e_get_current_pitch_transposed(engine_pattern_t *ep) {
-    s8 pitch = e_get_current_pitch(ep);
-    if (ep->p.steps[ep->ps.current_step].transpose == TRANSPOSE_UP) pitch += 12;
-    else if (ep->p.steps[ep->ps.current_step].transpose == TRANSPOSE_DOWN) pitch -= 12;
-    return pitch;
+    return e_get_pitch_transposed(ep, ep->ps.current_step);
 }
 
 void e_set_pitch(engine_pattern_t *ep, u8 step, s8 pitch) {
     if (step >= MAX_PATTERN_LENGTH) return;
-    ep->p.steps[step].pitch = pitch;
+    if (get_bit(e_get_gate_mask(ep), step)) {
+        remove_pitch(ep, ep->p.pitch[step]);
+        add_pitch(ep, pitch);
+    }
+    ep->p.pitch[step] = pitch;
+    ep->revision++;
 }
 
 // ----------------------------------------------------------------------------
 
 u8 e_get_current_gate(engine_pattern_t *ep) {
-    return ep->p.steps[ep->ps.current_step].gate;
+    return e_get_gate(ep, ep->ps.current_step);
 }
 
 u8 e_get_gate(engine_pattern_t *ep, u8 step) {
-    return ep->p.steps[step].gate;
+    if (get_bit(ep->p.gate_on, step)) return GATE_ON;
+    if (get_bit(ep->p.gate_tie, step)) return GATE_TIE;
+    return GATE_REST;
 }
 
 void e_set_gate(engine_pattern_t *ep, u8 step, u8 gate) {
     if (step >= MAX_PATTERN_LENGTH) return;
-    ep->p.steps[step].gate = gate;
+    u8 was_gated = get_bit(e_get_gate_mask(ep), step);
+    if (was_gated && gate == GATE_REST) remove_pitch(ep, ep->p.pitch[step]);
+    else if (!was_gated && gate != GATE_REST) add_pitch(ep, ep->p.pitch[step]);
+    set_bit(&ep->p.gate_on, step, gate == GATE_ON);
+    set_bit(&ep->p.gate_tie, step, gate == GATE_TIE);
+    ep->revision++;
 }
 
 // ----------------------------------------------------------------------------
 
 u8 e_get_current_accent(engine_pattern_t *ep) {
-    return ep->p.steps[ep->ps.current_step].accent;
+    return get_bit(ep->p.accent, ep->ps.current_step);
 }
 
 u8 e_get_accent(engine_pattern_t *ep, u8 step) {
-    return ep->p.steps[step].accent;
+    return get_bit(ep->p.accent, step);
 }
 
 void e_set_accent(engine_pattern_t *ep, u8 step, u8 accent) {
     if (step >= MAX_PATTERN_LENGTH) return;
-    ep->p.steps[step].accent = accent;
+    set_bit(&ep->p.accent, step, accent);
+    ep->revision++;
 }
 
 // ----------------------------------------------------------------------------
 
 u8 e_get_current_slide(engine_pattern_t *ep) {
-    return ep->p.steps[ep->ps.current_step].slide;
+    return get_bit(ep->p.slide, ep->ps.current_step);
 }
 
 u8 e_get_slide(engine_pattern_t *ep, u8 step) {
-    return ep->p.steps[step].slide;
+    return get_bit(ep->p.slide, step);
 }
 
 void e_set_slide(engine_pattern_t *ep, u8 step, u8 slide) {
     if (step >= MAX_PATTERN_LENGTH) return;
-    ep->p.steps[step].slide = slide;
+    set_bit(&ep->p.slide, step, slide);
+    ep->revision++;
 }
 
 // ----------------------------------------------------------------------------
 
 u8 e_get_current_transpose(engine_pattern_t *ep) {
-    return ep->p.steps[ep->ps.current_step].transpose;
+    return e_get_transpose(ep, ep->ps.current_step);
 }
 
 u8 e_get_transpose(engine_pattern_t *ep, u8 step) {
-    return ep->p.steps[step].transpose;
+    if (get_bit(ep->p.transpose_up, step)) return TRANSPOSE_UP;
+    if (get_bit(ep->p.transpose_down, step)) return TRANSPOSE_DOWN;
+    return TRANSPOSE_OFF;
 }
 
 void e_set_transpose(engine_pattern_t *ep, u8 step, u8 transpose) {
     if (step >= MAX_PATTERN_LENGTH) return;
-    ep->p.steps[step].transpose = transpose;
+    set_bit(&ep->p.transpose_up, step, transpose == TRANSPOSE_UP);
+    set_bit(&ep->p.transpose_down, step, transpose == TRANSPOSE_DOWN);
+    ep->revision++;
 }
 
 // ----------------------------------------------------------------------------
 
 u8 e_get_reset(engine_pattern_t *ep, u8 step) {
-    return ep->p.steps[step].is_reset;
+    return get_bit(ep->p.reset, step);
 }
 
 void e_set_reset(engine_pattern_t *ep, u8 step, u8 is_reset) {
     if (step >= MAX_PATTERN_LENGTH) return;
-    ep->p.steps[step].is_reset = is_reset;
+    set_bit(&ep->p.reset, step, is_reset);
+    ep->revision++;
+}
+
+// ----------------------------------------------------------------------------
+
+u8 e_get_current_ratchet(engine_pattern_t *ep) {
+    return e_get_ratchet(ep, ep->ps.current_step);
+}
+
+// ratchets are stored as count - 1 across two planes
+u8 e_get_ratchet(engine_pattern_t *ep, u8 step) {
+    return 1 + get_bit(ep->p.ratchet_lo, step) + (get_bit(ep->p.ratchet_hi, step) << 1);
+}
+
+void e_set_ratchet(engine_pattern_t *ep, u8 step, u8 ratchet) {
+    if (step >= MAX_PATTERN_LENGTH) return;
+    if (ratchet < 1) ratchet = 1;
+    else if (ratchet > MAX_RATCHETS) ratchet = MAX_RATCHETS;
+    ratchet--;
+    set_bit(&ep->p.ratchet_lo, step, ratchet & 1);
+    set_bit(&ep->p.ratchet_hi, step, ratchet & 2);
+    ep->revision++;
+}
+
+// ----------------------------------------------------------------------------
+
+void e_get_step(engine_pattern_t *ep, u8 step, step_t *s) {
+    s->pitch = e_get_pitch(ep, step);
+    s->gate = e_get_gate(ep, step);
+    s->accent = e_get_accent(ep, step);
+    s->slide = e_get_slide(ep, step);
+    s->transpose = e_get_transpose(ep, step);
+    s->is_reset = e_get_reset(ep, step);
+    s->ratchet = e_get_ratchet(ep, step);
+}
+
+void e_set_step(engine_pattern_t *ep, u8 step, step_t *s) {
+    if (step >= MAX_PATTERN_LENGTH) return;
+    e_set_pitch(ep, step, s->pitch);
+    e_set_gate(ep, step, s->gate);
+    e_set_accent(ep, step, s->accent);
+    e_set_slide(ep, step, s->slide);
+    e_set_transpose(ep, step, s->transpose);
+    e_set_reset(ep, step, s->is_reset);
+    e_set_ratchet(ep, step, s->ratchet);
+}
+
+// ----------------------------------------------------------------------------
+
+step_mask_t e_get_gate_mask(engine_pattern_t *ep) {
+    return ep->p.gate_on | ep->p.gate_tie;
+}
+
+step_mask_t e_get_tie_mask(engine_pattern_t *ep) {
+    return ep->p.gate_tie;
+}
+
+step_mask_t e_get_accent_mask(engine_pattern_t *ep) {
+    return ep->p.accent;
+}
+
+step_mask_t e_get_slide_mask(engine_pattern_t *ep) {
+    return ep->p.slide;
+}
+
+step_mask_t e_get_reset_mask(engine_pattern_t *ep) {
+    return ep->p.reset;
+}
+
+u32 e_get_used_pitches(engine_pattern_t *ep) {
+    return ep->pi.used;
+}
+
+// ----------------------------------------------------------------------------
+
+u8 e_encode_pattern(engine_pattern_t *ep, u8 *data) {
+    u8 length = 0, run = 0, token;
+    step_t s;
+    
+    data[length++] = PATTERN_ENCODING_VERSION;
+    
+    for (u8 i = 0; i < MAX_PATTERN_LENGTH; i++) {
+        e_get_step(ep, i, &s);
+        token = s.gate | (s.accent ? TOKEN_ACCENT : 0) | (s.slide ? TOKEN_SLIDE : 0) |
+            (s.transpose << TOKEN_TRANSPOSE_SHIFT) | (s.is_reset ? TOKEN_RESET : 0);
+        
+        if (!token && !s.pitch && s.ratchet == 1) {
+            // run points at the current blank run token, 0 if there is none
+            if (run && data[run] != TOKEN_BLANK_RUN_MAX) {
+                data[run]++;
+            } else {
+                run = length;
+                data[length++] = TOKEN_BLANK_RUN;
+            }
+            continue;
+        }
+        
+        run = 0;
+        data[length++] = token;
+        data[length++] = s.pitch | ((s.ratchet - 1) << TOKEN_RATCHET_SHIFT);
+    }
+    
+    return length;
+}
+
+u8 e_decode_pattern(engine_pattern_t *ep, u8 *data, u8 length) {
+    u8 i = 0, step = 0, run;
+    step_t s;
+    
+    // version 1 has no ratchets, the top pitch bits are always 0
+    if (!length || !data[i] || data[i] > PATTERN_ENCODING_VERSION) return 0;
+    i++;
+    
+    e_init(ep);
+    
+    while (step < MAX_PATTERN_LENGTH) {
+        if (i >= length) return 0;
+        
+        if (data[i] & TOKEN_BLANK_RUN) {
+            run = (data[i++] & ~TOKEN_BLANK_RUN) + 1;
+            if (run > MAX_PATTERN_LENGTH - step) return 0;
+            step += run;
+            continue;
+        }
+        
+        if (i + 1 >= length) return 0;
+        s.gate = data[i] & TOKEN_GATE_MASK;
+        s.accent = (data[i] & TOKEN_ACCENT) != 0;
+        s.slide = (data[i] & TOKEN_SLIDE) != 0;
+        s.transpose = (data[i] & TOKEN_TRANSPOSE_MASK) >> TOKEN_TRANSPOSE_SHIFT;
+        s.is_reset = (data[i] & TOKEN_RESET) != 0;
+        s.pitch = data[i + 1] & TOKEN_PITCH_MASK;
+        s.ratchet = (data[i + 1] >> TOKEN_RATCHET_SHIFT) + 1;
+        if (s.gate > GATE_TIE || s.transpose > TRANSPOSE_DOWN || s.pitch > MAX_PITCH_VALUE) return 0;
+        e_set_step(ep, step++, &s);
+        i += 2;
+    }
+    
+    return i;
 }
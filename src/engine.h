@@ -4,8 +4,9 @@
 
 #pragma once
 #include "types.h"
+#include "config.h"
 
-#define MAX_PATTERN_LENGTH 32
+#define MAX_PATTERN_LENGTH PATTERN_LENGTH
 #define MAX_PITCH_VALUE 23
 
 #define GATE_REST 0
@@ -16,6 +17,26 @@
 #define TRANSPOSE_UP   1
 #define TRANSPOSE_DOWN 2
 
+#define MAX_RATCHETS 4
+#define MAX_VOICES 4
+
+// encoded pattern: a version byte followed by step tokens. a token with the
+// high bit set is a run of 1-128 blank steps, otherwise it holds the step
+// flags and is followed by the pitch, with the ratchet count in the top
+// 3 bits of the pitch byte since version 2.
+#define PATTERN_ENCODING_VERSION 2
+#define ENCODED_PATTERN_MAX_SIZE (1 + MAX_PATTERN_LENGTH * 2)
+
+// one bit per step
+#if MAX_PATTERN_LENGTH > 32
+typedef u64 step_mask_t;
+#else
+typedef u32 step_mask_t;
+#endif
+
+#define STEP_BIT(step) ((step_mask_t)1 << (step))
+
+// unpacked view of a single step
 typedef struct {
     s8 pitch;
     u8 gate;
@@ -23,24 +44,71 @@ typedef struct {
     u8 slide;
     u8 transpose;
     u8 is_reset;
+    u8 ratchet;
 } step_t;
 
+// pitches are stored per step, everything else is stored as bit planes
+// with one bit per step
 typedef struct {
-    step_t steps[MAX_PATTERN_LENGTH];
+    s8 pitch[MAX_PATTERN_LENGTH];
+    step_mask_t gate_on;
+    step_mask_t gate_tie;
+    step_mask_t accent;
+    step_mask_t slide;
+    step_mask_t transpose_up;
+    step_mask_t transpose_down;
+    step_mask_t reset;
+    step_mask_t ratchet_lo;
+    step_mask_t ratchet_hi;
 } pattern_t;
 
 typedef struct {
     s8 current_step;
 } pattern_state_t;
 
+// number of gated steps using each pitch, kept up to date by the setters
+typedef struct {
+    u8 count[MAX_PITCH_VALUE + 1];
+    u32 used;
+} pitch_index_t;
+
+// revision counts edits, every setter bumps it so anything computed from
+// the pattern can tell when it's stale. copies carry it along.
 typedef struct {
     pattern_t p;
     pattern_state_t ps;
+    pitch_index_t pi;
+    u16 revision;
 } engine_pattern_t;
 
+// voices that step together. the state for each voice is kept in parallel
+// arrays so e_step_all is a single short loop. a voice plays a pattern it
+// doesn't own, step is where the voice is. it's mirrored into the pattern
+// state so the position carries over to a copy of the pattern.
+typedef struct {
+    engine_pattern_t *pattern[MAX_VOICES];
+    u8 step[MAX_VOICES];
+    u8 length[MAX_VOICES];
+    u8 count;
+    u16 revision;
+} engine_voices_t;
+
+// a step of a voice read ahead of the clock edge, along with the gate and
+// slide of the step after it. it stays valid until the voice moves on to a
+// different step or its pattern or the voices are edited.
+typedef struct {
+    engine_pattern_t *pattern;
+    u16 revision;
+    u16 voices_revision;
+    u8 step;
+    step_t s;
+    u8 next_gate;
+    u8 next_slide;
+} engine_lookahead_t;
+
 void e_init(engine_pattern_t *ep);
 void e_reset(engine_pattern_t *ep);
-void e_step(engine_pattern_t *ep);
+u8 e_step(engine_pattern_t *ep);
 
 u8 e_get_current_step(engine_pattern_t *ep);
 void e_set_current_step(engine_pattern_t *ep, u8 step);
@@ -69,3 +137,35 @@ void e_set_transpose(engine_pattern_t *ep, u8 step, u8 transpose);
 
 u8 e_get_reset(engine_pattern_t *ep, u8 step);
 void e_set_reset(engine_pattern_t *ep, u8 step, u8 is_reset);
+
+u8 e_get_current_ratchet(engine_pattern_t *ep);
+u8 e_get_ratchet(engine_pattern_t *ep, u8 step);
+void e_set_ratchet(engine_pattern_t *ep, u8 step, u8 ratchet);
+
+void e_get_step(engine_pattern_t *ep, u8 step, step_t *s);
+void e_set_step(engine_pattern_t *ep, u8 step, step_t *s);
+
+step_mask_t e_get_gate_mask(engine_pattern_t *ep);
+step_mask_t e_get_tie_mask(engine_pattern_t *ep);
+step_mask_t e_get_accent_mask(engine_pattern_t *ep);
+step_mask_t e_get_slide_mask(engine_pattern_t *ep);
+step_mask_t e_get_reset_mask(engine_pattern_t *ep);
+
+u32 e_get_used_pitches(engine_pattern_t *ep);
+
+void e_init_voices(engine_voices_t *ev, u8 count);
+u8 e_step_all(engine_voices_t *ev);
+u8 e_get_voice_count(engine_voices_t *ev);
+void e_set_voice_count(engine_voices_t *ev, u8 count);
+void e_set_voice_pattern(engine_voices_t *ev, u8 voice, engine_pattern_t *ep);
+u8 e_get_voice_step(engine_voices_t *ev, u8 voice);
+void e_set_voice_step(engine_voices_t *ev, u8 voice, u8 step);
+u8 e_get_voice_length(engine_voices_t *ev, u8 voice);
+void e_set_voice_length(engine_voices_t *ev, u8 voice, u8 length);
+u8 e_get_next_step(engine_voices_t *ev, u8 voice, u8 step);
+
+void e_prepare_step(engine_voices_t *ev, u8 voice, u8 step, engine_lookahead_t *la);
+u8 e_is_prepared(engine_voices_t *ev, u8 voice, engine_lookahead_t *la);
+
+u8 e_encode_pattern(engine_pattern_t *ep, u8 *data);
+u8 e_decode_pattern(engine_pattern_t *ep, u8 *data, u8 length);
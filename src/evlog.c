@@ -0,0 +1,83 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "evlog.h"
+
+#define VARINT_MAX_SIZE 10
+
+void evlog_init(evlog_t *log, u8 *buffer, u32 size) {
+    log->data = buffer;
+    log->size = size;
+    log->length = 0;
+    log->last_time = 0;
+    log->recording = size >= EVLOG_HEADER_SIZE;
+    if (!log->recording) return;
+    
+    log->data[log->length++] = EVLOG_MAGIC_1;
+    log->data[log->length++] = EVLOG_MAGIC_2;
+    log->data[log->length++] = EVLOG_VERSION;
+}
+
+void evlog_stop(evlog_t *log) {
+    log->recording = 0;
+}
+
+// returns 0 and stops recording once the buffer is full
+u8 evlog_record(evlog_t *log, u64 time, u8 event, u8 *data, u8 length) {
+    if (!log->recording) return 0;
+    
+    if (log->size - log->length < VARINT_MAX_SIZE + 2 + length) {
+        log->recording = 0;
+        return 0;
+    }
+    
+    u64 delta = time >= log->last_time ? time - log->last_time : 0;
+    log->last_time = time;
+    
+    do {
+        log->data[log->length++] = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+        delta >>= 7;
+    } while (delta);
+    
+    log->data[log->length++] = event;
+    log->data[log->length++] = length;
+    for (u8 i = 0; i < length; i++) log->data[log->length++] = data[i];
+    
+    return 1;
+}
+
+// returns 0 if the data doesn't start with a supported header
+u8 evlog_reader_init(evlog_reader_t *reader, u8 *data, u32 length) {
+    reader->data = data;
+    reader->length = length;
+    reader->position = EVLOG_HEADER_SIZE;
+    reader->time = 0;
+    
+    return length >= EVLOG_HEADER_SIZE && data[0] == EVLOG_MAGIC_1 &&
+        data[1] == EVLOG_MAGIC_2 && data[2] == EVLOG_VERSION;
+}
+
+// reads the next record, data needs room for EVLOG_MAX_DATA bytes. returns 0
+// at the end of the log or if the last record is truncated.
+u8 evlog_next(evlog_reader_t *reader, u8 *event, u8 *data, u8 *length) {
+    u64 delta = 0;
+    u8 shift = 0, byte;
+    u32 p = reader->position;
+    
+    do {
+        if (p >= reader->length || shift >= 64) return 0;
+        byte = reader->data[p++];
+        delta |= (u64)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    
+    if (reader->length - p < 2 || reader->length - p - 2 < reader->data[p + 1]) return 0;
+    *event = reader->data[p++];
+    *length = reader->data[p++];
+    for (u8 i = 0; i < *length; i++) data[i] = reader->data[p++];
+    
+    reader->time += delta;
+    reader->position = p;
+    return 1;
+}
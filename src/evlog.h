@@ -0,0 +1,42 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+
+// compact binary log of the events passed to process_event, so a session can
+// be replayed on the host. the log starts with EVLOG_MAGIC and the format
+// version, each record is the time since the previous record in ms as a
+// little endian base 128 varint followed by the event, the data length and
+// the data. timed events aren't recorded, replaying time brings them back.
+// midi bytes read by process_midi are recorded as EVLOG_MIDI records.
+
+#define EVLOG_MAGIC_1 'A'
+#define EVLOG_MAGIC_2 'E'
+#define EVLOG_VERSION 1
+#define EVLOG_HEADER_SIZE 3
+#define EVLOG_MAX_DATA 255
+#define EVLOG_MIDI 0xFF // not an event, the data is raw midi
+
+typedef struct {
+    u8 *data;
+    u32 size;
+    u32 length;
+    u64 last_time;
+    u8 recording;
+} evlog_t;
+
+typedef struct {
+    u8 *data;
+    u32 length;
+    u32 position;
+    u64 time;
+} evlog_reader_t;
+
+void evlog_init(evlog_t *log, u8 *buffer, u32 size);
+void evlog_stop(evlog_t *log);
+u8 evlog_record(evlog_t *log, u64 time, u8 event, u8 *data, u8 length);
+
+u8 evlog_reader_init(evlog_reader_t *reader, u8 *data, u32 length);
+u8 evlog_next(evlog_reader_t *reader, u8 *event, u8 *data, u8 *length);
@@ -0,0 +1,66 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "generator.h"
+
+#define DEFAULT_SEED 0x2545F491
+
+// how often each scale degree gets picked, the root, fifth and octave are
+// the most common in acid lines
+static const u8 degree_weights[12] = { 8, 1, 3, 3, 2, 3, 1, 5, 2, 2, 4, 1 };
+
+static u32 xorshift(u32 *state) {
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static u8 chance(u32 random, u8 probability) {
+    return (random & 0xFF) < probability || probability == GENERATOR_ALWAYS;
+}
+
+void generate_pattern(engine_pattern_t *ep, generator_t *g) {
+    u8 cumulative[MAX_PITCH_VALUE + 1];
+    u16 total = 0;
+    u32 state = g->seed ? g->seed : DEFAULT_SEED;
+    u32 a, b;
+    u8 gated = 0;
+    step_t s;
+    
+    for (u8 p = 0; p <= MAX_PITCH_VALUE; p++) {
+        if (g->scale & (1UL << p)) total += degree_weights[p % 12];
+        cumulative[p] = total;
+    }
+    
+    for (u8 step = 0; step < MAX_PATTERN_LENGTH; step++) {
+        a = xorshift(&state);
+        b = xorshift(&state);
+        
+        s.gate = !chance(a, g->density) ? GATE_REST : gated && chance(a >> 8, g->density >> 2) ? GATE_TIE : GATE_ON;
+        gated = s.gate != GATE_REST;
+        
+        // an empty scale plays the root only
+        s.pitch = 0;
+        if (total) {
+            u16 pick = (b >> 16) % total;
+            while (cumulative[s.pitch] <= pick) s.pitch++;
+        }
+        
+        s.accent = gated && chance(a >> 16, g->accent);
+        s.slide = gated && chance(a >> 24, g->slide);
+        s.transpose = !chance(b, g->octave) ? TRANSPOSE_OFF : b & 0x100 ? TRANSPOSE_UP : TRANSPOSE_DOWN;
+        s.is_reset = step == g->length - 1 && g->length < MAX_PATTERN_LENGTH;
+        s.ratchet = 1;
+        
+        e_set_step(ep, step, &s);
+    }
+}
+
+// mixes in something unpredictable, like the time of a key press
+u32 generator_next_seed(u32 seed, u32 entropy) {
+    u32 state = (seed ^ entropy) ? seed ^ entropy : DEFAULT_SEED;
+    return xorshift(&state);
+}
@@ -0,0 +1,26 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+#include "engine.h"
+
+// fills a pattern with a random acid line. the same settings always give the
+// same pattern. every step takes the same number of random draws, so changing
+// a probability keeps the pitches and only changes what depends on it.
+
+#define GENERATOR_ALWAYS 255
+
+typedef struct {
+    u32 seed;
+    u8 length;  // steps before the reset, MAX_PATTERN_LENGTH for none
+    u8 density; // chance of a gated step, out of GENERATOR_ALWAYS
+    u8 accent;
+    u8 slide;
+    u8 octave;
+    u32 scale;  // allowed pitches, one bit per pitch
+} generator_t;
+
+void generate_pattern(engine_pattern_t *ep, generator_t *g);
+u32 generator_next_seed(u32 seed, u32 entropy);
@@ -0,0 +1,94 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include <stddef.h>
+#include "history.h"
+
+#define HISTORY_MASK (HISTORY_SIZE - 1)
+
+#if HISTORY_SIZE & HISTORY_MASK || HISTORY_SIZE > 128
+#error "HISTORY_SIZE must be a power of 2, at most 128"
+#endif
+
+void history_init(history_t *h) {
+    h->head = 0;
+    h->undo_count = 0;
+    h->redo_count = 0;
+    h->group_open = 0;
+    h->joining = 0;
+}
+
+// edits recorded until history_end_group are undone together
+void history_start_group(history_t *h) {
+    h->group_open = 1;
+    h->joining = 0;
+}
+
+void history_end_group(history_t *h) {
+    h->group_open = 0;
+    h->joining = 0;
+}
+
+// a new edit drops everything that could be redone
+void history_record(history_t *h, u8 pattern, u8 step, u8 field, s8 from, s8 to) {
+    if (from == to) return;
+    
+    history_edit_t *e = &h->edits[h->head];
+    e->pattern = pattern;
+    e->step = step;
+    e->field = field | (h->joining ? HISTORY_JOINED : 0);
+    e->from = from;
+    e->to = to;
+    
+    h->head = (h->head + 1) & HISTORY_MASK;
+    if (h->undo_count < HISTORY_SIZE) h->undo_count++;
+    h->redo_count = 0;
+    h->joining = h->group_open;
+}
+
+// changes what the last edit sets, for gestures that keep adjusting one
+// field. returns 0 if the last edit is to something else, was undone or
+// belongs to a group.
+u8 history_amend(history_t *h, u8 pattern, u8 step, u8 field, s8 to) {
+    if (!h->undo_count || h->redo_count || h->group_open) return 0;
+    
+    history_edit_t *e = &h->edits[(h->head - 1) & HISTORY_MASK];
+    if (e->pattern != pattern || e->step != step || e->field != field) return 0;
+    
+    e->to = to;
+    return 1;
+}
+
+// returns the edit to revert or NULL if there is nothing to undo
+history_edit_t *history_undo(history_t *h) {
+    if (!h->undo_count) return NULL;
+    
+    h->head = (h->head - 1) & HISTORY_MASK;
+    h->undo_count--;
+    h->joining = 0;
+    h->redo_count++;
+    return &h->edits[h->head];
+}
+
+// returns the edit to apply again or NULL if there is nothing to redo
+history_edit_t *history_redo(history_t *h) {
+    if (!h->redo_count) return NULL;
+    
+    history_edit_t *e = &h->edits[h->head];
+    h->head = (h->head + 1) & HISTORY_MASK;
+    h->redo_count--;
+    h->undo_count++;
+    h->joining = 0;
+    return e;
+}
+
+// 1 if the next edit history_redo returns belongs with the last one
+u8 history_redo_joined(history_t *h) {
+    return h->redo_count && (h->edits[h->head].field & HISTORY_JOINED);
+}
+
+// drops everything that could be undone, redo is kept
+void history_forget(history_t *h) {
+    h->undo_count = 0;
+}
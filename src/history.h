@@ -0,0 +1,56 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+
+// undo/redo for step edits. every edit is a 5 byte record of the pattern,
+// step, field and the values before and after, kept in a ring of fixed
+// size. once the ring is full the oldest edits are forgotten. an edit can
+// be joined to the one before it so a whole gesture is undone at once.
+
+#ifndef HISTORY_SIZE
+#define HISTORY_SIZE 64 // must be a power of 2, at most 128
+#endif
+
+#define HISTORY_PITCH     0
+#define HISTORY_GATE      1
+#define HISTORY_ACCENT    2
+#define HISTORY_SLIDE     3
+#define HISTORY_TRANSPOSE 4
+#define HISTORY_RESET     5
+#define HISTORY_RATCHET   6
+#define HISTORY_PATTERN   7 // the whole pattern, kept by the caller
+#define HISTORY_PRESET    8 // from and to are preset indexes
+
+#define HISTORY_JOINED 0x80
+#define HISTORY_FIELD_MASK 0x7F
+
+typedef struct {
+    u8 pattern;
+    u8 step;
+    u8 field; // HISTORY_* field, HISTORY_JOINED if undone with the edit before
+    s8 from;
+    s8 to;
+} history_edit_t;
+
+typedef struct {
+    history_edit_t edits[HISTORY_SIZE];
+    u8 head;
+    u8 undo_count;
+    u8 redo_count;
+    u8 group_open;
+    u8 joining;
+} history_t;
+
+void history_init(history_t *h);
+void history_start_group(history_t *h);
+void history_end_group(history_t *h);
+void history_record(history_t *h, u8 pattern, u8 step, u8 field, s8 from, s8 to);
+u8 history_amend(history_t *h, u8 pattern, u8 step, u8 field, s8 to);
+
+history_edit_t *history_undo(history_t *h);
+history_edit_t *history_redo(history_t *h);
+u8 history_redo_joined(history_t *h);
+void history_forget(history_t *h);
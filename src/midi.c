@@ -0,0 +1,109 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "midi.h"
+
+// number of data bytes following a status byte
+static u8 data_length(u8 status) {
+    if (status < 0xC0 || (status >= 0xE0 && status < 0xF0)) return 2;
+    if (status < 0xE0) return 1;
+    if (status == 0xF2) return 2;
+    if (status == 0xF1 || status == 0xF3) return 1;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// ring
+
+void midi_ring_init(midi_ring_t *r) {
+    r->head = r->tail = 0;
+}
+
+u8 midi_ring_free(midi_ring_t *r) {
+    return (u8)(r->tail - r->head - 1);
+}
+
+// all or nothing, returns 0 if there isn't enough room
+u8 midi_ring_write(midi_ring_t *r, const u8 *data, u8 length) {
+    if (length > midi_ring_free(r)) return 0;
+    
+    u8 head = r->head;
+    for (u8 i = 0; i < length; i++) r->data[head++] = data[i];
+    
+    // the bytes have to be there before the consumer can see them
+    __asm__ __volatile__ ("" ::: "memory");
+    r->head = head;
+    return 1;
+}
+
+u8 midi_ring_read(midi_ring_t *r, u8 *byte) {
+    u8 tail = r->tail;
+    if (tail == r->head) return 0;
+    
+    *byte = r->data[tail];
+    __asm__ __volatile__ ("" ::: "memory");
+    r->tail = tail + 1;
+    return 1;
+}
+
+// ----------------------------------------------------------------------------
+// parser
+
+void midi_parser_init(midi_parser_t *p) {
+    p->status = 0;
+    p->count = 0;
+    p->sysex = 0;
+}
+
+// consumes bytes until a message is complete, returns 0 once the ring is
+// empty. an unfinished message is kept for the next call.
+u8 midi_parse(midi_parser_t *p, midi_ring_t *r, midi_message_t *m) {
+    u8 byte;
+    
+    while (midi_ring_read(r, &byte)) {
+        if (byte >= MIDI_CLOCK) { // realtime, doesn't touch running status
+            m->status = byte;
+            m->data1 = m->data2 = 0;
+            return 1;
+        }
+        
+        if (byte & 0x80) {
+            // system common messages cancel running status
+            p->sysex = byte == MIDI_SYSEX;
+            p->status = byte == MIDI_SYSEX || byte == MIDI_SYSEX_END ? 0 : byte;
+            p->count = 0;
+            
+            if (p->status >= MIDI_SYSEX && !data_length(byte)) {
+                p->status = 0;
+                m->status = byte;
+                m->data1 = m->data2 = 0;
+                return 1;
+            }
+            continue;
+        }
+        
+        if (p->sysex || !p->status) continue;
+        
+        p->data[p->count++] = byte;
+        if (p->count < data_length(p->status)) continue;
+        
+        m->status = p->status;
+        m->data1 = p->data[0];
+        m->data2 = p->count > 1 ? p->data[1] : 0;
+        p->count = 0;
+        if (p->status >= MIDI_SYSEX) p->status = 0;
+        return 1;
+    }
+    
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// output
+
+// writes a complete message or nothing, returns 0 if the ring is full
+u8 midi_send(midi_ring_t *r, u8 status, u8 data1, u8 data2) {
+    u8 message[3] = { status, data1, data2 };
+    return midi_ring_write(r, message, 1 + data_length(status));
+}
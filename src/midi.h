@@ -0,0 +1,54 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+
+// midi byte streams. whoever owns the port writes received bytes into a
+// ring, the parser then reads them straight out of the ring one message at
+// a time, keeping only the data bytes of an unfinished message. running
+// status is supported, realtime bytes can appear anywhere and sysex is
+// skipped. outgoing messages go into another ring for the port to drain.
+
+#define MIDI_RING_SIZE 256 // indices are u8 and wrap on their own
+
+#define MIDI_NOTE_OFF 0x80
+#define MIDI_NOTE_ON  0x90
+#define MIDI_SYSEX    0xF0
+#define MIDI_SYSEX_END 0xF7
+#define MIDI_CLOCK    0xF8
+#define MIDI_START    0xFA
+#define MIDI_CONTINUE 0xFB
+#define MIDI_STOP     0xFC
+
+#define MIDI_PPQN 24
+
+typedef struct {
+    u8 data[MIDI_RING_SIZE];
+    volatile u8 head; // written by the producer
+    volatile u8 tail; // written by the consumer
+} midi_ring_t;
+
+typedef struct {
+    u8 status; // running status or a system common status, 0 if none
+    u8 data[2];
+    u8 count;
+    u8 sysex;
+} midi_parser_t;
+
+typedef struct {
+    u8 status;
+    u8 data1;
+    u8 data2;
+} midi_message_t;
+
+void midi_ring_init(midi_ring_t *r);
+u8 midi_ring_write(midi_ring_t *r, const u8 *data, u8 length);
+u8 midi_ring_free(midi_ring_t *r);
+u8 midi_ring_read(midi_ring_t *r, u8 *byte);
+
+void midi_parser_init(midi_parser_t *p);
+u8 midi_parse(midi_parser_t *p, midi_ring_t *r, midi_message_t *m);
+
+u8 midi_send(midi_ring_t *r, u8 status, u8 data1, u8 data2);
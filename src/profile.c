@@ -0,0 +1,59 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "profile.h"
+
+void latency_reset(latency_t *l) {
+    l->count = l->last = l->worst = 0;
+    for (u8 i = 0; i < LATENCY_BUCKETS; i++) l->histogram[i] = 0;
+}
+
+void latency_record(latency_t *l, u32 cycles) {
+    u32 limit = CYCLES_PER_US;
+    u8 bucket = 0;
+    
+    while (cycles >= limit && bucket < LATENCY_BUCKETS - 1) {
+        limit <<= 1;
+        bucket++;
+    }
+    
+    l->histogram[bucket]++;
+    l->count++;
+    l->last = cycles;
+    if (cycles > l->worst) l->worst = cycles;
+}
+
+u32 latency_bucket_limit_us(u8 bucket) {
+    return 1UL << bucket;
+}
+
+// ----------------------------------------------------------------------------
+
+void window_reset(window_t *w) {
+    w->count = w->peak = w->last_count = w->last_peak = 0;
+}
+
+void window_count(window_t *w) {
+    w->count++;
+}
+
+void window_peak(window_t *w, u32 value) {
+    if (value > w->peak) w->peak = value;
+}
+
+void window_roll(window_t *w) {
+    w->last_count = w->count;
+    w->last_peak = w->peak;
+    w->count = w->peak = 0;
+}
+
+// for bar graphs on a log scale, each bit is one more LED
+u8 bit_length(u32 value) {
+    u8 length = 0;
+    while (value) {
+        value >>= 1;
+        length++;
+    }
+    return length;
+}
@@ -0,0 +1,44 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "compiler.h"
+#include "types.h"
+
+// cycle counter frequency, ansible and teletype run at 60MHz
+#ifndef CYCLES_PER_US
+#define CYCLES_PER_US 60
+#endif
+
+#define get_cycles() ((u32)Get_sys_count())
+
+// bucket 0 is < 1us, each bucket after that doubles, the last one holds
+// everything else
+#define LATENCY_BUCKETS 8
+
+typedef struct {
+    u32 count;
+    u32 last;
+    u32 worst;
+    u32 histogram[LATENCY_BUCKETS];
+} latency_t;
+
+void latency_reset(latency_t *l);
+void latency_record(latency_t *l, u32 cycles);
+u32 latency_bucket_limit_us(u8 bucket);
+
+// a count and a peak over a window of time. window_roll keeps the finished
+// window around for display and starts a new one.
+typedef struct {
+    u32 count;
+    u32 peak;
+    u32 last_count;
+    u32 last_peak;
+} window_t;
+
+void window_reset(window_t *w);
+void window_count(window_t *w);
+void window_peak(window_t *w, u32 value);
+void window_roll(window_t *w);
+u8 bit_length(u32 value);
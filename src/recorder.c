@@ -0,0 +1,57 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "recorder.h"
+
+#define RECORDER_MASK (RECORDER_SIZE - 1)
+
+#if RECORDER_SIZE & RECORDER_MASK
+#error "RECORDER_SIZE must be a power of 2"
+#endif
+
+void recorder_init(recorder_t *r) {
+    r->head = r->tail = 0;
+}
+
+// producer side, returns 0 and drops the note when the buffer is full
+u8 recorder_push(recorder_t *r, u32 time, s8 note, u8 accent) {
+    u8 head = r->head;
+    if (((head + 1) & RECORDER_MASK) == r->tail) return 0;
+    
+    recorder_note_t *n = &r->notes[head];
+    n->time = time;
+    n->note = note;
+    n->accent = accent;
+    
+    // the note has to be complete before the consumer can see it
+    __asm__ __volatile__ ("" ::: "memory");
+    r->head = (head + 1) & RECORDER_MASK;
+    return 1;
+}
+
+// consumer side, returns 0 when there is nothing to pop
+u8 recorder_pop(recorder_t *r, recorder_note_t *n) {
+    u8 tail = r->tail;
+    if (tail == r->head) return 0;
+    
+    *n = r->notes[tail];
+    __asm__ __volatile__ ("" ::: "memory");
+    r->tail = (tail + 1) & RECORDER_MASK;
+    return 1;
+}
+
+// the number of steps from the step that started at clock_time to the step
+// nearest to time, after taking away the latency. a note can move at most
+// one step back. without a known clock period everything goes to the step
+// at clock_time.
+s8 recorder_quantize(u32 time, u32 clock_time, u16 period, u16 latency) {
+    if (!period) return 0;
+    
+    s32 offset = (s32)(time - latency - clock_time) + (period >> 1);
+    s32 steps = offset >= 0 ? offset / period : -((period - 1 - offset) / period);
+    
+    if (steps < -1) return -1;
+    if (steps > 127) return 127;
+    return steps;
+}
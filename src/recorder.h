@@ -0,0 +1,31 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+
+// live recording capture. the grid handler pushes timestamped keyboard
+// presses and releases, the clock handler pops them once the step outputs
+// are written. there is exactly one producer and one consumer, each index
+// is only written by one side, so no locking is needed.
+
+#define RECORDER_SIZE 16 // must be a power of 2
+#define RECORDER_RELEASE -1
+
+typedef struct {
+    u32 time;
+    s8 note; // RECORDER_RELEASE for a release
+    u8 accent;
+} recorder_note_t;
+
+typedef struct {
+    recorder_note_t notes[RECORDER_SIZE];
+    volatile u8 head; // written by the producer
+    volatile u8 tail; // written by the consumer
+} recorder_t;
+
+void recorder_init(recorder_t *r);
+u8 recorder_push(recorder_t *r, u32 time, s8 note, u8 accent);
+u8 recorder_pop(recorder_t *r, recorder_note_t *n);
+s8 recorder_quantize(u32 time, u32 clock_time, u16 period, u16 latency);
@@ -0,0 +1,46 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "scale.h"
+#include "interface.h"
+
+// one bit per semitone above the root: chromatic, major, minor, dorian,
+// phrygian, mixolydian, harmonic minor, minor pentatonic
+static const u16 scales[SCALE_COUNT] = { 0xFFF, 0xAB5, 0x5AD, 0x6AD, 0x5AB, 0x6B5, 0x9AD, 0x4A9 };
+
+// cents away from equal temperament for each semitone above the root:
+// equal, 5-limit just intonation, pythagorean
+static const s8 tunings[TUNING_COUNT][12] = {
+    { 0,   0, 0,  0,   0,  0,   0, 0,   0,   0,  0,   0 },
+    { 0,  12, 4, 16, -14, -2, -10, 2,  14, -16, 18, -12 },
+    { 0, -10, 4, -6,   8, -2,  12, 2,  -8,   6, -4,  10 }
+};
+
+// note_to_pitch is calibrated per semitone, cents are interpolated between
+// the two nearest semitones
+static u16 note_to_dac(u8 note, s8 cents) {
+    u16 dac = note_to_pitch(note);
+    if (cents > 0) return dac + (s32)(note_to_pitch(note + 1) - dac) * cents / 100;
+    if (cents < 0 && note) return dac - (s32)(dac - note_to_pitch(note - 1)) * -cents / 100;
+    return dac;
+}
+
+// offset is the note the root of the lowest octave sits on. this calls
+// note_to_pitch for every entry so keep it out of the clock path.
+void scale_build_table(pitch_table_t *table, u8 scale, u8 root, u8 tuning, u8 offset) {
+    static const s8 octaves[TRANSPOSE_COUNT] = { 0, 12, -12 };
+    u16 mask = scales[scale < SCALE_COUNT ? scale : 0];
+    const s8 *cents = tunings[tuning < TUNING_COUNT ? tuning : 0];
+    
+    for (u8 p = 0; p <= MAX_PITCH_VALUE; p++) {
+        u8 degree = p % 12;
+        while (!(mask & (1 << degree))) degree--;
+        u8 pitch = p - p % 12 + degree;
+        
+        for (u8 t = 0; t < TRANSPOSE_COUNT; t++) {
+            table->note[t][p] = offset + root % ROOT_COUNT + pitch + octaves[t];
+            table->dac[t][p] = note_to_dac(table->note[t][p], cents[degree]);
+        }
+    }
+}
@@ -0,0 +1,24 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+#include "engine.h"
+
+// maps every pitch and transpose combination straight to a dac value for the
+// selected scale, root and tuning. pattern pitches are semitones above the
+// root, pitches outside the scale go down to the nearest scale note.
+
+#define SCALE_COUNT 8
+#define TUNING_COUNT 3
+#define ROOT_COUNT 12
+#define TRANSPOSE_COUNT 3
+
+// note has the same notes as semitones for midi, without the tuning
+typedef struct {
+    u16 dac[TRANSPOSE_COUNT][MAX_PITCH_VALUE + 1];
+    u8 note[TRANSPOSE_COUNT][MAX_PITCH_VALUE + 1];
+} pitch_table_t;
+
+void scale_build_table(pitch_table_t *table, u8 scale, u8 root, u8 tuning, u8 offset);
@@ -0,0 +1,43 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "slide.h"
+
+// remaining distance to the target in Q15, exp(-4t) scaled to end at 0
+static const u16 curve[SLIDE_CURVE_SIZE] = {
+    32767, 30714, 28787, 26978, 25281, 23688, 22193, 20790,
+    19474, 18238, 17078, 15990, 14969, 14010, 13111, 12267,
+    11474, 10731, 10033,  9378,  8764,  8187,  7646,  7138,
+     6661,  6214,  5794,  5400,  5030,  4683,  4357,  4052,
+     3765,  3496,  3243,  3006,  2783,  2574,  2378,  2195,
+     2022,  1860,  1708,  1565,  1431,  1306,  1188,  1077,
+      973,   876,   784,   698,   618,   542,   471,   405,
+      342,   283,   228,   177,   128,    83,    40,     0
+};
+
+// slides from one value to another over the given number of updates
+void slide_start(slide_t *s, u16 from, u16 to, u16 updates) {
+    s->target = to;
+    s->delta = (s32)from - to;
+    s->phase = 0;
+    s->increment = updates ? (SLIDE_CURVE_SIZE << SLIDE_PHASE_SHIFT) / updates : 0;
+    s->active = s->increment && s->delta;
+}
+
+void slide_stop(slide_t *s) {
+    s->active = 0;
+}
+
+// returns the next value, the slide stops once it reaches the target
+u16 slide_update(slide_t *s) {
+    if (!s->active) return s->target;
+    
+    s->phase += s->increment;
+    if (s->phase >= SLIDE_CURVE_SIZE << SLIDE_PHASE_SHIFT) {
+        s->active = 0;
+        return s->target;
+    }
+    
+    return s->target + ((s->delta * curve[s->phase >> SLIDE_PHASE_SHIFT]) >> 15);
+}
@@ -0,0 +1,24 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+
+// exponential portamento between two CV values in fixed point. the curve is
+// a lookup table so each update is one lookup and one multiply-add.
+
+#define SLIDE_CURVE_SIZE 64
+#define SLIDE_PHASE_SHIFT 8
+
+typedef struct {
+    u16 target;
+    s32 delta;
+    u16 phase;
+    u16 increment;
+    u8 active;
+} slide_t;
+
+void slide_start(slide_t *s, u16 from, u16 to, u16 updates);
+void slide_stop(slide_t *s);
+u16 slide_update(slide_t *s);
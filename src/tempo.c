@@ -0,0 +1,62 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "tempo.h"
+
+void tempo_init(tempo_t *t) {
+    t->last_edge = t->next_edge = 0;
+    t->period = 0;
+    t->outliers = 0;
+    t->started = 0;
+}
+
+// the first interval after a start is taken as it is, after that only
+// intervals within the jitter window are averaged in
+void tempo_edge(tempo_t *t, u64 now) {
+    u64 interval = now - t->last_edge;
+    
+    // the same edge twice
+    if (t->started && !interval) return;
+    
+    if (!t->started || interval > TEMPO_MAX_PERIOD) {
+        t->period = 0;
+    } else if (!t->period) {
+        t->period = interval << TEMPO_FRACTION_BITS;
+        t->outliers = 0;
+    } else {
+        s32 error = (s32)(interval << TEMPO_FRACTION_BITS) - (s32)t->period;
+        s32 window = t->period >> TEMPO_JITTER_SHIFT;
+        
+        if (error <= window && error >= -window) {
+            t->period += error / (1 << TEMPO_SMOOTHING);
+            t->outliers = 0;
+        } else if (++t->outliers >= TEMPO_RELOCK) {
+            t->period = interval << TEMPO_FRACTION_BITS;
+            t->outliers = 0;
+        }
+    }
+    
+    t->started = 1;
+    t->last_edge = now;
+    t->next_edge = now + tempo_get_period(t);
+}
+
+// returns 1 when the clock has just stopped, the next edge starts over
+// so the gap before it is not taken as a period
+u8 tempo_check(tempo_t *t, u64 now) {
+    if (!t->period) return 0;
+    
+    u64 since = now - t->last_edge;
+    if (since <= TEMPO_MAX_PERIOD && since <= (u32)tempo_get_period(t) * TEMPO_STOP_PERIODS) return 0;
+    
+    t->period = 0;
+    t->outliers = 0;
+    t->started = 0;
+    return 1;
+}
+
+// in ms, 0 while there is no estimate
+u16 tempo_get_period(tempo_t *t) {
+    return (t->period + (1 << (TEMPO_FRACTION_BITS - 1))) >> TEMPO_FRACTION_BITS;
+}
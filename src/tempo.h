@@ -0,0 +1,32 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+
+// tempo tracker for an external clock. the period is kept in fixed point
+// and each interval pulls it part of the way, so a jittery clock settles
+// on its average. an interval far off the estimate is ignored, if the next
+// one agrees the tracker jumps to the new tempo. every edge sets the phase,
+// next_edge is where the following one is expected.
+
+#define TEMPO_MAX_PERIOD 4000 // ms, a longer interval starts over
+#define TEMPO_FRACTION_BITS 4
+#define TEMPO_SMOOTHING 2     // each interval moves the period by 1/2^n of the error
+#define TEMPO_JITTER_SHIFT 3  // intervals more than period/2^n off are outliers
+#define TEMPO_RELOCK 2        // outliers in a row that make a new tempo
+#define TEMPO_STOP_PERIODS 3  // periods without an edge before the clock is stopped
+
+typedef struct {
+    u64 last_edge;
+    u64 next_edge;
+    u32 period;
+    u8 outliers;
+    u8 started;
+} tempo_t;
+
+void tempo_init(tempo_t *t);
+void tempo_edge(tempo_t *t, u64 now);
+u8 tempo_check(tempo_t *t, u64 now);
+u16 tempo_get_period(tempo_t *t);
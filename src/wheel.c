@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#include "wheel.h"
+
+void wheel_init(wheel_t *w) {
+    w->position = 0;
+    wheel_clear(w);
+}
+
+void wheel_clear(wheel_t *w) {
+    for (u8 i = 0; i < WHEEL_SLOTS; i++) w->slots[i] = WHEEL_NONE;
+    for (u8 i = 0; i < WHEEL_EVENTS; i++) w->events[i].next = i + 1 < WHEEL_EVENTS ? i + 1 : WHEEL_NONE;
+    w->free = 0;
+    w->count = 0;
+}
+
+// schedules an event to fire after the given number of ticks (at least 1),
+// returns 0 if the pool is full
+u8 wheel_schedule(wheel_t *w, u16 ticks, u8 type, u8 data) {
+    if (w->free == WHEEL_NONE) return 0;
+    if (!ticks) ticks = 1;
+    if (ticks > WHEEL_MAX_TICKS) ticks = WHEEL_MAX_TICKS;
+    
+    u8 index = w->free;
+    wheel_event_t *e = &w->events[index];
+    u8 slot = (w->position + ticks) & (WHEEL_SLOTS - 1);
+    
+    w->free = e->next;
+    e->rounds = (ticks - 1) / WHEEL_SLOTS;
+    e->type = type;
+    e->data = data;
+    e->next = w->slots[slot];
+    w->slots[slot] = index;
+    w->count++;
+    
+    return 1;
+}
+
+// moves the wheel one tick forward and fires everything that is due. the
+// callback can schedule new events but must not clear the wheel.
+void wheel_advance(wheel_t *w, wheel_callback_t callback) {
+    w->position = (w->position + 1) & (WHEEL_SLOTS - 1);
+    
+    u8 index = w->slots[w->position], next;
+    wheel_event_t *e;
+    
+    // events scheduled by the callback land on a fresh list
+    w->slots[w->position] = WHEEL_NONE;
+    
+    while (index != WHEEL_NONE) {
+        e = &w->events[index];
+        next = e->next;
+        
+        if (e->rounds) {
+            e->rounds--;
+            e->next = w->slots[w->position];
+            w->slots[w->position] = index;
+        } else {
+            e->next = w->free;
+            w->free = index;
+            w->count--;
+            callback(e->type, e->data);
+        }
+        
+        index = next;
+    }
+}
+
+u8 wheel_count(wheel_t *w) {
+    return w->count;
+}
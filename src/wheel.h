@@ -0,0 +1,38 @@
+// ----------------------------------------------------------------------------
+// acperience (c) scanner darkly 2021
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+
+// a hashed timing wheel with one slot per tick. events further away than
+// WHEEL_SLOTS ticks wait for the wheel to come around. events live in a
+// fixed pool, scheduling and firing never allocate.
+
+#define WHEEL_SLOTS 32 // must be a power of 2
+#define WHEEL_EVENTS 16
+#define WHEEL_NONE 255
+#define WHEEL_MAX_TICKS (WHEEL_SLOTS * 256)
+
+typedef struct {
+    u8 next;
+    u8 rounds;
+    u8 type;
+    u8 data;
+} wheel_event_t;
+
+typedef struct {
+    wheel_event_t events[WHEEL_EVENTS];
+    u8 slots[WHEEL_SLOTS];
+    u8 free;
+    u8 position;
+    u8 count;
+} wheel_t;
+
+typedef void (*wheel_callback_t)(u8 type, u8 data);
+
+void wheel_init(wheel_t *w);
+void wheel_clear(wheel_t *w);
+u8 wheel_schedule(wheel_t *w, u16 ticks, u8 type, u8 data);
+void wheel_advance(wheel_t *w, wheel_callback_t callback);
+u8 wheel_count(wheel_t *w);